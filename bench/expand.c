@@ -0,0 +1,122 @@
+/*
+ * expand.c -- Palette expansion kernel benchmark.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "kernels/kernels.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+/** Number of pixels expanded per pass. */
+#define PIXELS      (1024 * 1024)
+/** Minimum time to spend timing each case, in seconds. */
+#define MIN_TIME    0.5
+
+
+/** Get the current time in seconds. */
+double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Time the current expand kernel on IN, and return the number of pixels it
+ * expands per second.
+ */
+double time_expand(uint32_t *out, uint8_t const *in, uint32_t const *palette)
+{
+    size_t passes = 0;
+    double const start = now();
+    double elapsed = 0.0;
+    do
+    {
+        kernels->expand(out, in, PIXELS, palette);
+        ++passes;
+        elapsed = now() - start;
+    } while (elapsed < MIN_TIME);
+    return (double)passes * PIXELS / elapsed;
+}
+
+
+int main(void)
+{
+    static size_t const table_sizes[] = {256, 16, 2};
+
+    uint8_t *const in = malloc(PIXELS);
+    uint32_t *const out = malloc(PIXELS * sizeof(*out));
+    uint32_t *const expected = malloc(PIXELS * sizeof(*expected));
+    if (in == NULL || out == NULL || expected == NULL)
+    {
+        fputs("out of memory\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t palette[256];
+    srand(1);
+    for (size_t i = 0; i < 256; ++i)
+        palette[i] = ((uint32_t)rand() << 8) | 0xff;
+
+    enum Kernels_CPU const best = kernels_detect();
+    bool mismatch = false;
+    printf("%-8s %-8s %14s %8s\n", "colors", "kernel", "pixels/s", "speedup");
+    for (size_t t = 0; t < sizeof(table_sizes) / sizeof(*table_sizes); ++t)
+    {
+        for (size_t i = 0; i < PIXELS; ++i)
+            in[i] = rand() % table_sizes[t];
+
+        /* A fast kernel is no use if it's wrong, so each one's output is
+         * checked against the scalar kernel's first. */
+        kernels_init(Kernels_CPU_Scalar);
+        kernels->expand(expected, in, PIXELS, palette);
+
+        double scalar = 0.0;
+        for (enum Kernels_CPU cpu = Kernels_CPU_Scalar; cpu <= best; ++cpu)
+        {
+            kernels_init(cpu);
+            memset(out, 0, PIXELS * sizeof(*out));
+            kernels->expand(out, in, PIXELS, palette);
+            if (memcmp(out, expected, PIXELS * sizeof(*out)) != 0)
+            {
+                fprintf(
+                    stderr, "%s: output differs from scalar with %zu colors\n",
+                    kernels_cpu_name(cpu), table_sizes[t]);
+                mismatch = true;
+                continue;
+            }
+            double const rate = time_expand(out, in, palette);
+            if (cpu == Kernels_CPU_Scalar)
+                scalar = rate;
+            printf(
+                "%-8zu %-8s %14.0f %7.2fx\n",
+                table_sizes[t], kernels_cpu_name(cpu), rate, rate / scalar);
+        }
+    }
+
+    free(expected);
+    free(out);
+    free(in);
+    return mismatch? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -21,6 +21,7 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -30,14 +31,31 @@
 void usage(char const *name, bool print_long)
 {
     printf("Usage: %s [OPTION]... FILE\n", name);
+    printf("  or:  %s --probe [OPTION]... FILE...\n", name);
     if (print_long)
     {
         puts("\
-Display GIF images.\n\
+Display GIF images.  With FILE of -, read standard input.\n\
 \n\
 OPTIONS\n\
-      --help     display this help and exit\n\
-      --version  output version information and exit\n\
+      --threads=N    decode using N threads (default: one per CPU core)\n\
+      --cpu=ISA      use pixel kernels for ISA: auto, scalar, sse2 or avx2\n\
+                       (default: auto, the best the CPU supports)\n\
+      --probe        print the metadata of each FILE as a line of JSON,\n\
+                       without decoding or displaying anything\n\
+      --alloc-stats  print how much memory the GIF and its frames take\n\
+      --frame-cache-mb=N\n\
+                     decode frames as they're shown, keeping at most N\n\
+                       megabytes of them (default: decode all up front)\n\
+      --rgb565       keep frames decoded up front in 16-bit color when they\n\
+                       need more than 256 colors, losing some precision\n\
+      --compress-frames\n\
+                     keep frames decoded up front compressed in memory,\n\
+                       except for those near the one being shown\n\
+      --merge-frames when frames are decoded up front, show runs of\n\
+                       identical frames as one, adding up their delays\n\
+      --help         display this help and exit\n\
+      --version      output version information and exit\n\
 \n\
 Report bugs to: <https://github.com/Treecase/gifview/issues>\n\
 pkg home page: <https://github.com/Treecase/gifview>\
@@ -58,15 +76,36 @@ There is NO WARRANTY, to the extent permitted by law.\
 ");
 }
 
-char const *parse_args(int argc, char *argv[])
+struct Args parse_args(int argc, char *argv[])
 {
     static char const *const short_options = "";
     static struct option const long_options[] = {
-        {"help",    no_argument, NULL, 0},
-        {"version", no_argument, NULL, 0},
+        {"help",    no_argument,       NULL, 0},
+        {"version", no_argument,       NULL, 0},
+        {"threads", required_argument, NULL, 0},
+        {"cpu",     required_argument, NULL, 0},
+        {"probe",   no_argument,       NULL, 0},
+        {"alloc-stats", no_argument,   NULL, 0},
+        {"frame-cache-mb", required_argument, NULL, 0},
+        {"rgb565",  no_argument,       NULL, 0},
+        {"compress-frames", no_argument, NULL, 0},
+        {"merge-frames", no_argument,  NULL, 0},
         {NULL, 0, NULL, 0}
     };
 
+    struct Args args = {
+        .filename = NULL,
+        .probe = false,
+        .filenames = NULL,
+        .file_count = 0,
+        .threads = 0,
+        .cpu = Kernels_CPU_Auto,
+        .alloc_stats = false,
+        .frame_cache_mb = 0,
+        .rgb565 = false,
+        .compress_frames = false,
+        .merge_frames = false,
+    };
     bool bad_args = false;
     int c, long_opt_ptr;
     while (
@@ -91,6 +130,77 @@ char const *parse_args(int argc, char *argv[])
                 version();
                 exit(EXIT_SUCCESS);
                 break;
+
+            /* --threads */
+            case 2:
+                {
+                    char *end = NULL;
+                    long const n = strtol(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || n < 1)
+                    {
+                        fprintf(
+                            stderr, "%s: invalid thread count '%s'\n",
+                            argv[0], optarg);
+                        bad_args = true;
+                    }
+                    else
+                        args.threads = n;
+                }
+                break;
+
+            /* --cpu */
+            case 3:
+                if (!kernels_cpu_from_name(optarg, &args.cpu))
+                {
+                    fprintf(
+                        stderr, "%s: unknown instruction set '%s'\n",
+                        argv[0], optarg);
+                    bad_args = true;
+                }
+                break;
+
+            /* --probe */
+            case 4:
+                args.probe = true;
+                break;
+
+            /* --alloc-stats */
+            case 5:
+                args.alloc_stats = true;
+                break;
+
+            /* --frame-cache-mb */
+            case 6:
+                {
+                    char *end = NULL;
+                    long const n = strtol(optarg, &end, 10);
+                    if (*optarg == '\0' || *end != '\0' || n < 1
+                        || (unsigned long)n > SIZE_MAX / (1024 * 1024))
+                    {
+                        fprintf(
+                            stderr, "%s: invalid frame cache size '%s'\n",
+                            argv[0], optarg);
+                        bad_args = true;
+                    }
+                    else
+                        args.frame_cache_mb = n;
+                }
+                break;
+
+            /* --rgb565 */
+            case 7:
+                args.rgb565 = true;
+                break;
+
+            /* --compress-frames */
+            case 8:
+                args.compress_frames = true;
+                break;
+
+            /* --merge-frames */
+            case 9:
+                args.merge_frames = true;
+                break;
             }
             break;
 
@@ -112,11 +222,14 @@ char const *parse_args(int argc, char *argv[])
         usage(argv[0], false);
         exit(EXIT_FAILURE);
     }
-    else if (optind + 1 != argc)
+    else if (optind + 1 != argc && !args.probe)
     {
         /* TODO: Handle this properly instead of just exiting. */
         usage(argv[0], false);
         exit(EXIT_FAILURE);
     }
-    return argv[optind];
+    args.filename = argv[optind];
+    args.filenames = (char const *const *)argv + optind;
+    args.file_count = argc - optind;
+    return args;
 }
@@ -20,7 +20,49 @@
 #ifndef GIFVIEW_ARGS_H
 #define GIFVIEW_ARGS_H
 
+#include "kernels/kernels.h"
+
 #include <stdbool.h>
+#include <stddef.h>
+
+
+/** Values given on the command line. */
+struct Args
+{
+    /** Path of the GIF to view. */
+    char const *filename;
+    /** If true, print the metadata of FILENAMES instead of viewing them. */
+    bool probe;
+    /** All the paths given, FILE_COUNT of them.  FILENAME is the first. */
+    char const *const *filenames;
+    size_t file_count;
+    /** Number of threads to decode with, or 0 to pick automatically. */
+    unsigned int threads;
+    /** Instruction set to limit the pixel kernels to. */
+    enum Kernels_CPU cpu;
+    /** If true, print statistics about the memory used to load the GIF. */
+    bool alloc_stats;
+    /**
+     * Most megabytes of frames to keep, decoding them as they're shown, or 0
+     * to decode them all up front.
+     */
+    size_t frame_cache_mb;
+    /**
+     * If true, opaque frames with too many colors for one palette are kept
+     * at 16 bits per pixel.
+     */
+    bool rgb565;
+    /**
+     * If true, frames decoded up front are kept compressed, except for those
+     * near the one being shown.
+     */
+    bool compress_frames;
+    /**
+     * If true, runs of identical frames decoded up front are shown as one
+     * frame, for as long as all of them.
+     */
+    bool merge_frames;
+};
 
 
 /** Print GIFView help information. */
@@ -30,7 +72,7 @@ void usage(char const *name, bool print_long);
 void version(void);
 
 /** Parse command-line arguments. */
-char const *parse_args(int argc, char *argv[]);
+struct Args parse_args(int argc, char *argv[]);
 
 
 #endif /* GIFVIEW_ARGS_H */
@@ -0,0 +1,866 @@
+/*
+ * framestore.c -- Keyframe and delta frame storage.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "framestore.h"
+#include "lz.h"
+#include "util.h"
+#include "kernels/kernels.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+
+/**
+ * Shared by a compressed FrameStore and its WORKER thread.  The frames from
+ * the keyframe of PLAYHEAD up to AHEAD frames past it, wrapping around to the
+ * start, are kept decompressed.  The worker decompresses any of them that
+ * aren't, and the store drops the others.  LOCK guards PLAYHEAD, QUIT and
+ * the PIXELS of FRAMES.  FRAMES is the COUNT frames of the store, whose
+ * pixels are PIXEL_BYTES each.
+ */
+struct FrameStore_Cold
+{
+    struct FrameStore_Frame *frames;
+    size_t count;
+    size_t pixel_bytes;
+    size_t ahead;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t worker;
+    bool has_worker;
+    size_t playhead;
+    bool quit;
+};
+
+
+/** Returns row Y of the frame PIXELS, whose rows are PITCH bytes apart. */
+uint32_t const *_row(uint32_t const *pixels, size_t pitch, int y)
+{
+    return (uint32_t const *)((uint8_t const *)pixels + y * pitch);
+}
+
+/** Bytes per pixel of FORMAT. */
+size_t _format_bytes(enum FrameStore_Format format)
+{
+    static size_t const BYTES[] = {
+        [FrameStore_Format_Index8] = 1,
+        [FrameStore_Format_RGB565] = 2,
+        [FrameStore_Format_RGB24] = 3,
+        [FrameStore_Format_RGBA32] = 4,
+    };
+    return BYTES[format];
+}
+
+/**
+ * Look up the index of COLOR in STORE's palette, adding it if it's new.
+ * Returns -1 if it's new and the palette is full.
+ */
+int _palette_index(struct FrameStore *store, uint32_t color)
+{
+    size_t const mask = 2 * FRAMESTORE_PALETTE_SIZE - 1;
+    /* Fibonacci hashing, keeping enough of the top bits to index SLOTS. */
+    size_t slot = (uint32_t)(color * UINT32_C(2654435761)) >> 23;
+    for (;; slot = (slot + 1) & mask)
+    {
+        uint16_t const entry = store->slots[slot];
+        if (entry == 0)
+            break;
+        if (store->palette[entry - 1] == color)
+            return entry - 1;
+    }
+    if (store->palette_count == FRAMESTORE_PALETTE_SIZE)
+        return -1;
+    store->palette[store->palette_count++] = color;
+    store->slots[slot] = store->palette_count;
+    return store->palette_count - 1;
+}
+
+/**
+ * Find a format that can hold both STORE's frames and the RECT of the frame
+ * PIXELS, whose rows are PITCH bytes apart.  Any new colors are added to the
+ * palette while there's room.
+ */
+enum FrameStore_Format _format_for(
+    struct FrameStore *restrict store,
+    uint32_t const *restrict pixels, size_t pitch,
+    SDL_Rect const *restrict rect)
+{
+    enum FrameStore_Format format = store->format;
+    if (format == FrameStore_Format_RGBA32)
+        return format;
+    for (int y = rect->y; y < rect->y + rect->h; ++y)
+    {
+        uint32_t const *const row = _row(pixels, pitch, y);
+        for (int x = rect->x; x < rect->x + rect->w; ++x)
+        {
+            uint8_t rgba[4];
+            memcpy(rgba, &row[x], sizeof(rgba));
+            if (rgba[3] != 0xFF)
+            {
+                store->opaque = false;
+                if (format != FrameStore_Format_Index8)
+                    return FrameStore_Format_RGBA32;
+            }
+            if (format == FrameStore_Format_Index8
+                && _palette_index(store, row[x]) < 0)
+            {
+                if (!store->opaque)
+                    return FrameStore_Format_RGBA32;
+                format = (store->lossy?
+                    FrameStore_Format_RGB565 : FrameStore_Format_RGB24);
+            }
+        }
+    }
+    return format;
+}
+
+/**
+ * Store the N RGBA pixels IN in FORMAT, in OUT.  Indexed pixels are looked up
+ * in STORE's palette, which must already hold their colors.
+ */
+void _encode_row(
+    struct FrameStore *restrict store, enum FrameStore_Format format,
+    uint8_t *restrict out, uint32_t const *restrict in, size_t n)
+{
+    switch (format)
+    {
+    case FrameStore_Format_Index8:
+        for (size_t i = 0; i < n; ++i)
+            out[i] = _palette_index(store, in[i]);
+        break;
+    case FrameStore_Format_RGB565:
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint8_t rgba[4];
+            memcpy(rgba, &in[i], sizeof(rgba));
+            uint16_t const pixel = (
+                (rgba[0] >> 3) << 11 | (rgba[1] >> 2) << 5 | rgba[2] >> 3);
+            memcpy(out + 2 * i, &pixel, sizeof(pixel));
+        }
+        break;
+    case FrameStore_Format_RGB24:
+        for (size_t i = 0; i < n; ++i)
+            memcpy(out + 3 * i, &in[i], 3);
+        break;
+    case FrameStore_Format_RGBA32:
+        memcpy(out, in, n * sizeof(*in));
+        break;
+    }
+}
+
+/**
+ * Expand the N pixels IN, stored in FORMAT, to RGBA pixels in OUT.  Indexed
+ * pixels are looked up in STORE's palette.
+ */
+void _decode_row(
+    struct FrameStore const *restrict store, enum FrameStore_Format format,
+    uint32_t *restrict out, uint8_t const *restrict in, size_t n)
+{
+    switch (format)
+    {
+    case FrameStore_Format_Index8:
+        kernels->expand(out, in, n, store->palette);
+        break;
+    case FrameStore_Format_RGB565:
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint16_t pixel;
+            memcpy(&pixel, in + 2 * i, sizeof(pixel));
+            uint8_t const r = pixel >> 11, g = (pixel >> 5) & 0x3F;
+            uint8_t const b = pixel & 0x1F;
+            /* Repeat the top bits in the low ones, so white stays white. */
+            uint8_t const rgba[4] = {
+                r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 0xFF};
+            memcpy(&out[i], rgba, sizeof(rgba));
+        }
+        break;
+    case FrameStore_Format_RGB24:
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint8_t const rgba[4] = {
+                in[3 * i], in[3 * i + 1], in[3 * i + 2], 0xFF};
+            memcpy(&out[i], rgba, sizeof(rgba));
+        }
+        break;
+    case FrameStore_Format_RGBA32:
+        memcpy(out, in, n * sizeof(*out));
+        break;
+    }
+}
+
+/** Convert every frame in STORE to FORMAT. */
+void _convert(struct FrameStore *store, enum FrameStore_Format format)
+{
+    enum FrameStore_Format const old_format = store->format;
+    uint32_t *const row = malloc(
+        (store->width? store->width : 1) * sizeof(*row));
+    if (row == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    for (size_t i = 0; i < store->count; ++i)
+    {
+        struct FrameStore_Frame *const frame = &store->frames[i];
+        if (frame->pixels == NULL)
+            continue;
+        size_t const pixels = (size_t)frame->rect.w * frame->rect.h;
+        uint8_t *const converted = malloc(pixels * _format_bytes(format));
+        if (converted == NULL)
+            fatal("malloc: %s\n", strerror(errno));
+        for (int y = 0; y < frame->rect.h; ++y)
+        {
+            size_t const offset = (size_t)y * frame->rect.w;
+            _decode_row(
+                store, old_format, row,
+                frame->pixels + offset * _format_bytes(old_format),
+                frame->rect.w);
+            _encode_row(
+                store, format, converted + offset * _format_bytes(format),
+                row, frame->rect.w);
+        }
+        free(frame->pixels);
+        frame->pixels = converted;
+    }
+    free(row);
+    store->bytes = (
+        store->bytes / _format_bytes(old_format) * _format_bytes(format));
+    store->format = format;
+}
+
+/** Hash the WIDTH by HEIGHT frame PIXELS, with rows PITCH bytes apart. */
+uint64_t _hash_frame(
+    uint32_t const *pixels, size_t pitch, int width, int height)
+{
+    /* FNV-1a, a pixel at a time rather than a byte. */
+    uint64_t hash = 0xcbf29ce484222325;
+    for (int y = 0; y < height; ++y)
+    {
+        uint32_t const *const row = _row(pixels, pitch, y);
+        for (int x = 0; x < width; ++x)
+        {
+            hash ^= row[x];
+            hash *= 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Find the smallest rectangle holding every pixel that differs between
+ * STORE's canvas and the frame PIXELS.  Returns an empty rectangle if they're
+ * the same.
+ */
+SDL_Rect _diff_rect(
+    struct FrameStore const *restrict store,
+    uint32_t const *restrict pixels, size_t pitch)
+{
+    size_t const row_bytes = store->width * sizeof(*pixels);
+    uint32_t const *const canvas = store->canvas;
+
+    int top = 0;
+    while (top < store->height
+        && memcmp(
+            _row(canvas, row_bytes, top), _row(pixels, pitch, top),
+            row_bytes) == 0)
+    {
+        ++top;
+    }
+    if (top == store->height)
+        return (SDL_Rect){0, 0, 0, 0};
+    int bottom = store->height - 1;
+    while (memcmp(
+            _row(canvas, row_bytes, bottom), _row(pixels, pitch, bottom),
+            row_bytes) == 0)
+    {
+        --bottom;
+    }
+
+    /* Each row only needs checking outside the columns already known to
+     * have changed. */
+    int left = store->width, right = -1;
+    for (int y = top; y <= bottom; ++y)
+    {
+        uint32_t const *const a = _row(canvas, row_bytes, y);
+        uint32_t const *const b = _row(pixels, pitch, y);
+        for (int x = 0; x < left; ++x)
+        {
+            if (a[x] != b[x])
+            {
+                left = x;
+                break;
+            }
+        }
+        for (int x = store->width - 1; x > right; --x)
+        {
+            if (a[x] != b[x])
+            {
+                right = x;
+                break;
+            }
+        }
+    }
+    return (SDL_Rect){left, top, right - left + 1, bottom - top + 1};
+}
+
+/** Size of the pixels of FRAME, which are PIXEL_BYTES each. */
+size_t _frame_size(struct FrameStore_Frame const *frame, size_t pixel_bytes)
+{
+    return (size_t)frame->rect.w * frame->rect.h * pixel_bytes;
+}
+
+/**
+ * Number of frames COLD keeps decompressed while PLAYHEAD is shown, starting
+ * from its keyframe.
+ */
+size_t _window_size(struct FrameStore_Cold const *cold, size_t playhead)
+{
+    size_t const size = (
+        playhead - cold->frames[playhead].key + 1 + cold->ahead);
+    return size < cold->count? size : cold->count;
+}
+
+/** Returns true if COLD keeps frame INDEX decompressed while at PLAYHEAD. */
+bool _is_warm(struct FrameStore_Cold const *cold, size_t playhead, size_t index)
+{
+    size_t const key = cold->frames[playhead].key;
+    return (index + cold->count - key) % cold->count < (
+        _window_size(cold, playhead));
+}
+
+/** Decompress FRAME, whose pixels are PIXEL_BYTES each, into a new buffer. */
+uint8_t *_unpack(struct FrameStore_Frame const *frame, size_t pixel_bytes)
+{
+    size_t const size = _frame_size(frame, pixel_bytes);
+    uint8_t *const pixels = malloc(size);
+    if (pixels == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    if (!lz_decompress(frame->packed, frame->packed_size, pixels, size))
+        fatal("framestore: compressed frame is corrupt\n");
+    return pixels;
+}
+
+/** Decompress the frames COLD is meant to keep decompressed, one by one. */
+void *_cold_worker(void *data)
+{
+    struct FrameStore_Cold *const cold = data;
+    pthread_mutex_lock(&cold->lock);
+    while (!cold->quit)
+    {
+        size_t const key = cold->frames[cold->playhead].key;
+        size_t const window = _window_size(cold, cold->playhead);
+        struct FrameStore_Frame *frame = NULL;
+        for (size_t n = 0; n < window && frame == NULL; ++n)
+        {
+            struct FrameStore_Frame *const f = (
+                &cold->frames[(key + n) % cold->count]);
+            if (f->pixels == NULL && f->packed != NULL)
+                frame = f;
+        }
+        if (frame == NULL)
+        {
+            pthread_cond_wait(&cold->wake, &cold->lock);
+            continue;
+        }
+
+        /* The compressed data never changes, so it can be read unlocked. */
+        pthread_mutex_unlock(&cold->lock);
+        uint8_t *const pixels = _unpack(frame, cold->pixel_bytes);
+        pthread_mutex_lock(&cold->lock);
+        /* The playhead may have moved on, or the store got to it first. */
+        bool const wanted = (
+            frame->pixels == NULL
+            && _is_warm(cold, cold->playhead, frame - cold->frames));
+        if (wanted)
+            frame->pixels = pixels;
+        else
+            free(pixels);
+    }
+    pthread_mutex_unlock(&cold->lock);
+    return NULL;
+}
+
+/**
+ * Get the pixels of FRAME in STORE, decompressing them now if the worker
+ * hasn't yet.  Only the store drops decompressed pixels, so they stay valid
+ * until it next moves its playhead.  Frames the playhead doesn't keep
+ * decompressed are decompressed into a new buffer, and OWNED is set to true
+ * to say the caller must free it.
+ */
+uint8_t const *_frame_pixels(
+    struct FrameStore *restrict store, struct FrameStore_Frame *restrict frame,
+    bool *restrict owned)
+{
+    struct FrameStore_Cold *const cold = store->cold;
+    *owned = false;
+    if (cold == NULL)
+        return frame->pixels;
+    pthread_mutex_lock(&cold->lock);
+    uint8_t *pixels = frame->pixels;
+    pthread_mutex_unlock(&cold->lock);
+    if (pixels != NULL || frame->packed == NULL)
+        return pixels;
+
+    pixels = _unpack(frame, cold->pixel_bytes);
+    pthread_mutex_lock(&cold->lock);
+    if (frame->pixels != NULL)
+    {
+        free(pixels);
+        pixels = frame->pixels;
+    }
+    else if (_is_warm(cold, cold->playhead, frame - store->frames))
+        frame->pixels = pixels;
+    else
+        *owned = true;
+    pthread_mutex_unlock(&cold->lock);
+    return pixels;
+}
+
+/**
+ * Move the playhead of STORE's COLD to PLAYHEAD, dropping the frames that
+ * aren't near it any more, and wake the worker to decompress the ones that
+ * now are.
+ */
+void _move_playhead(struct FrameStore *store, size_t playhead)
+{
+    struct FrameStore_Cold *const cold = store->cold;
+    pthread_mutex_lock(&cold->lock);
+    /* Only frames near the old playhead can have been decompressed. */
+    size_t const old = cold->playhead;
+    size_t const key = cold->frames[old].key;
+    size_t const window = _window_size(cold, old);
+    for (size_t n = 0; n < window; ++n)
+    {
+        size_t const i = (key + n) % cold->count;
+        struct FrameStore_Frame *const frame = &cold->frames[i];
+        if (frame->packed != NULL && frame->pixels != NULL
+            && !_is_warm(cold, playhead, i))
+        {
+            free(frame->pixels);
+            frame->pixels = NULL;
+        }
+    }
+    cold->playhead = playhead;
+    pthread_cond_signal(&cold->wake);
+    pthread_mutex_unlock(&cold->lock);
+}
+
+/** Draw the pixels of FRAME onto STORE's canvas. */
+void _apply_frame(
+    struct FrameStore *restrict store,
+    struct FrameStore_Frame *restrict frame)
+{
+    SDL_Rect const *const r = &frame->rect;
+    size_t const row_bytes = r->w * _format_bytes(store->format);
+    bool owned;
+    uint8_t const *const pixels = _frame_pixels(store, frame, &owned);
+    for (int y = 0; y < r->h; ++y)
+    {
+        _decode_row(
+            store, store->format,
+            store->canvas + (size_t)(r->y + y) * store->width + r->x,
+            pixels + y * row_bytes,
+            r->w);
+    }
+    if (owned)
+        free((uint8_t *)pixels);
+}
+
+/**
+ * Change STORE's canvas to frame INDEX, returning the part of it that was
+ * rewritten in CHANGED.
+ */
+void _seek(
+    struct FrameStore *restrict store, size_t index,
+    SDL_Rect *restrict changed)
+{
+    *changed = (SDL_Rect){0, 0, 0, 0};
+    if (index == store->current)
+        return;
+    struct FrameStore_Frame *const frame = &store->frames[index];
+    if (frame->copy != FRAMESTORE_NONE)
+    {
+        _seek(store, frame->copy, changed);
+        store->current = index;
+        return;
+    }
+
+    /* Going forwards from the canvas is cheaper than starting from the
+     * keyframe, as long as the canvas is already past it.  A canvas on a
+     * copy is as good as one on the frame it copies. */
+    size_t from = frame->key;
+    size_t at = store->current;
+    if (at != FRAMESTORE_NONE && store->frames[at].copy != FRAMESTORE_NONE
+        && !(at < index && at >= from))
+    {
+        at = store->frames[at].copy;
+    }
+    if (at == index)
+    {
+        store->current = index;
+        return;
+    }
+    if (at < index && at >= from)
+        from = at + 1;
+    else if (store->frames[from].copy != FRAMESTORE_NONE)
+    {
+        /* Copies are never of frames built on other copies (see
+         * _find_copy), so this goes no deeper. */
+        _seek(store, store->frames[from].copy, changed);
+        from++;
+    }
+    for (size_t i = from; i <= index; ++i)
+    {
+        _apply_frame(store, &store->frames[i]);
+        SDL_UnionRect(changed, &store->frames[i].rect, changed);
+    }
+    store->current = index;
+}
+
+/**
+ * Find the slot of STORE's ORIGINALS that holds, or would hold, the frame
+ * with HASH.
+ */
+size_t *_original_slot(struct FrameStore const *store, uint64_t hash)
+{
+    size_t const mask = store->originals_capacity - 1;
+    /* Fibonacci hashing, keeping the top bits. */
+    size_t slot = (size_t)((hash * UINT64_C(0x9e3779b97f4a7c15)) >> 32) & mask;
+    for (;; slot = (slot + 1) & mask)
+    {
+        size_t const entry = store->originals[slot];
+        if (entry == 0 || store->frames[entry - 1].hash == hash)
+            return &store->originals[slot];
+    }
+}
+
+/**
+ * Make frame INDEX of STORE the one new frames with its hash are copies of,
+ * growing ORIGINALS to keep it at most half full.
+ */
+void _add_original(struct FrameStore *store, size_t index)
+{
+    if (2 * (store->originals_count + 1) > store->originals_capacity)
+    {
+        size_t *const old = store->originals;
+        size_t const old_capacity = store->originals_capacity;
+        store->originals_capacity = old_capacity? 2 * old_capacity : 64;
+        store->originals = calloc(
+            store->originals_capacity, sizeof(*store->originals));
+        if (store->originals == NULL)
+            fatal("calloc: %s\n", strerror(errno));
+        for (size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old[i] != 0)
+                *_original_slot(store, store->frames[old[i] - 1].hash) = old[i];
+        }
+        free(old);
+    }
+    size_t *const slot = _original_slot(store, store->frames[index].hash);
+    if (*slot == 0)
+        store->originals_count++;
+    *slot = index + 1;
+}
+
+/**
+ * Look for a frame in STORE identical to PIXELS, each row PITCH bytes after
+ * the last, which is being added as FRAME.  If one is found, FRAME is made a
+ * copy of it.  Copies are only made of frames whose keyframe isn't a copy,
+ * so that seeking never goes through more than one, and only the latest of
+ * those with the same hash is checked (see ORIGINALS).
+ *
+ * Checking a frame means rebuilding it on the canvas, which then has to be
+ * refilled with the whole of PIXELS.  A copy refills it here, and any other
+ * FRAME is made a keyframe so that adding it does.
+ */
+void _find_copy(
+    struct FrameStore *restrict store, struct FrameStore_Frame *restrict frame,
+    uint32_t const *restrict pixels, size_t pitch)
+{
+    size_t const index = frame - store->frames;
+    if (store->originals_count == 0)
+        return;
+    size_t const entry = *_original_slot(store, frame->hash);
+    if (entry == 0)
+        return;
+    size_t const original = entry - 1;
+
+    /* Same hash isn't proof, so compare them as they'd be stored. */
+    SDL_Rect changed;
+    _seek(store, original, &changed);
+    size_t const row_bytes = store->width * _format_bytes(store->format);
+    uint8_t *const a = malloc(row_bytes? 2 * row_bytes : 1);
+    if (a == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    uint8_t *const b = a + row_bytes;
+    bool same = true;
+    for (int y = 0; y < store->height && same; ++y)
+    {
+        _encode_row(
+            store, store->format, a,
+            store->canvas + (size_t)y * store->width, store->width);
+        _encode_row(
+            store, store->format, b, _row(pixels, pitch, y), store->width);
+        same = memcmp(a, b, row_bytes) == 0;
+    }
+    free(a);
+
+    frame->key = index;
+    if (same)
+    {
+        frame->copy = original;
+        frame->rect = (SDL_Rect){0, 0, 0, 0};
+        for (int y = 0; y < store->height; ++y)
+        {
+            memcpy(
+                store->canvas + (size_t)y * store->width,
+                _row(pixels, pitch, y), store->width * sizeof(*pixels));
+        }
+    }
+    else
+        frame->rect = (SDL_Rect){0, 0, store->width, store->height};
+}
+
+
+struct FrameStore framestore_new(
+    int width, int height, size_t interval, bool lossy)
+{
+    struct FrameStore out = {
+        .width = width,
+        .height = height,
+        .interval = interval? interval : 1,
+        .frames = NULL,
+        .count = 0,
+        .capacity = 0,
+        .bytes = 0,
+        .format = FrameStore_Format_Index8,
+        .palette = {0},
+        .palette_count = 0,
+        .slots = {0},
+        .opaque = true,
+        .lossy = lossy,
+        .originals = NULL,
+        .originals_count = 0,
+        .originals_capacity = 0,
+        .canvas = NULL,
+        .current = FRAMESTORE_NONE,
+        .cold = NULL,
+    };
+    size_t const canvas_size = (size_t)width * height * sizeof(*out.canvas);
+    out.canvas = calloc(canvas_size? canvas_size : 1, 1);
+    if (out.canvas == NULL)
+        fatal("calloc: %s\n", strerror(errno));
+    return out;
+}
+
+void framestore_push(
+    struct FrameStore *restrict store,
+    uint32_t const *restrict pixels, size_t pitch,
+    bool key)
+{
+    if (store->count == store->capacity)
+    {
+        store->capacity = store->capacity? 2 * store->capacity : 16;
+        store->frames = realloc(
+            store->frames, store->capacity * sizeof(*store->frames));
+        if (store->frames == NULL)
+            fatal("realloc: %s\n", strerror(errno));
+    }
+    size_t const index = store->count;
+    struct FrameStore_Frame *const frame = &store->frames[index];
+    SDL_Rect const whole = {0, 0, store->width, store->height};
+    frame->hash = _hash_frame(pixels, pitch, store->width, store->height);
+
+    /* The canvas still holds the last frame, so what changed is found by
+     * comparing against it.  A frame where everything changed costs as much
+     * as a keyframe, so it might as well be one. */
+    if (index == 0 || index - store->frames[index - 1].key >= store->interval)
+        key = true;
+    if (!key)
+    {
+        frame->rect = _diff_rect(store, pixels, pitch);
+        key = frame->rect.w == whole.w && frame->rect.h == whole.h;
+    }
+    if (key)
+    {
+        frame->key = index;
+        frame->rect = whole;
+    }
+    else
+        frame->key = store->frames[index - 1].key;
+
+    enum FrameStore_Format const format = _format_for(
+        store, pixels, pitch, &frame->rect);
+    if (format != store->format)
+        _convert(store, format);
+
+    /* The canvas gets the frame as it was given, not as it was stored, so
+     * lossy formats don't make unchanged pixels look different next time.
+     * It has to be refilled completely after _find_copy. */
+    frame->copy = FRAMESTORE_NONE;
+    if (index != 0 && frame->rect.w != 0)
+        _find_copy(store, frame, pixels, pitch);
+
+    frame->pixels = NULL;
+    frame->packed = NULL;
+    frame->packed_size = 0;
+    size_t const row_bytes = frame->rect.w * _format_bytes(store->format);
+    if (row_bytes != 0 && frame->rect.h != 0)
+    {
+        frame->pixels = malloc(row_bytes * frame->rect.h);
+        if (frame->pixels == NULL)
+            fatal("malloc: %s\n", strerror(errno));
+        store->bytes += row_bytes * frame->rect.h;
+    }
+    for (int y = 0; y < frame->rect.h; ++y)
+    {
+        uint32_t const *const row = (
+            _row(pixels, pitch, frame->rect.y + y) + frame->rect.x);
+        _encode_row(
+            store, store->format, frame->pixels + y * row_bytes, row,
+            frame->rect.w);
+        memcpy(
+            store->canvas + (size_t)(frame->rect.y + y) * store->width
+                + frame->rect.x,
+            row, frame->rect.w * sizeof(*row));
+    }
+    store->count++;
+    store->current = FRAMESTORE_NONE;
+    if (frame->copy == FRAMESTORE_NONE
+        && store->frames[frame->key].copy == FRAMESTORE_NONE)
+    {
+        _add_original(store, index);
+    }
+}
+
+bool framestore_is_unchanged(
+    struct FrameStore const *restrict store,
+    uint32_t const *restrict pixels, size_t pitch)
+{
+    SDL_Rect const rect = _diff_rect(store, pixels, pitch);
+    return store->count != 0 && rect.w == 0;
+}
+
+void framestore_seek(
+    struct FrameStore *restrict store, size_t index,
+    SDL_Rect *restrict changed)
+{
+    /* The playhead moves first, so that only the frames it keeps
+     * decompressed get kept decompressed while seeking. */
+    if (store->cold)
+        _move_playhead(store, index);
+    _seek(store, index, changed);
+}
+
+void framestore_compress(struct FrameStore *store, size_t ahead)
+{
+    if (store->cold != NULL || store->count == 0)
+        return;
+    struct FrameStore_Cold *const cold = malloc(sizeof(*cold));
+    if (cold == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    cold->frames = store->frames;
+    cold->count = store->count;
+    cold->pixel_bytes = _format_bytes(store->format);
+    cold->ahead = ahead;
+    cold->has_worker = false;
+    cold->playhead = (
+        store->current != FRAMESTORE_NONE? store->current : 0);
+    cold->quit = false;
+
+    store->bytes = 0;
+    for (size_t i = 0; i < store->count; ++i)
+    {
+        struct FrameStore_Frame *const frame = &store->frames[i];
+        size_t const size = _frame_size(frame, cold->pixel_bytes);
+        store->bytes += size;
+        if (size == 0)
+            continue;
+        uint8_t *const packed = malloc(lz_bound(size));
+        if (packed == NULL)
+            fatal("malloc: %s\n", strerror(errno));
+        size_t const packed_size = lz_compress(frame->pixels, size, packed);
+        if (packed_size >= size)
+        {
+            free(packed);
+            continue;
+        }
+        /* Failing to give back the spare room isn't worth giving up on. */
+        uint8_t *const shrunk = realloc(packed, packed_size);
+        frame->packed = shrunk != NULL? shrunk : packed;
+        frame->packed_size = packed_size;
+        store->bytes -= size - packed_size;
+        if (!_is_warm(cold, cold->playhead, i))
+        {
+            free(frame->pixels);
+            frame->pixels = NULL;
+        }
+    }
+
+    pthread_mutex_init(&cold->lock, NULL);
+    pthread_cond_init(&cold->wake, NULL);
+    int const err = pthread_create(&cold->worker, NULL, _cold_worker, cold);
+    if (err != 0)
+        warn("pthread_create: %s\n", strerror(err));
+    else
+        cold->has_worker = true;
+    store->cold = cold;
+}
+
+char const *framestore_format_name(enum FrameStore_Format format)
+{
+    switch (format)
+    {
+    case FrameStore_Format_Index8:
+        return "INDEX8";
+    case FrameStore_Format_RGB565:
+        return "RGB565";
+    case FrameStore_Format_RGB24:
+        return "RGB24";
+    case FrameStore_Format_RGBA32:
+        return "RGBA32";
+    }
+    return "unknown";
+}
+
+void framestore_free(struct FrameStore store)
+{
+    struct FrameStore_Cold *const cold = store.cold;
+    if (cold != NULL)
+    {
+        pthread_mutex_lock(&cold->lock);
+        cold->quit = true;
+        pthread_cond_signal(&cold->wake);
+        pthread_mutex_unlock(&cold->lock);
+        if (cold->has_worker)
+            pthread_join(cold->worker, NULL);
+        pthread_cond_destroy(&cold->wake);
+        pthread_mutex_destroy(&cold->lock);
+        free(cold);
+    }
+    for (size_t i = 0; i < store.count; ++i)
+    {
+        free(store.frames[i].pixels);
+        free(store.frames[i].packed);
+    }
+    free(store.frames);
+    free(store.canvas);
+    free(store.originals);
+}
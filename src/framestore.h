@@ -0,0 +1,188 @@
+/*
+ * framestore.h -- Keyframe and delta frame storage.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_FRAMESTORE_H
+#define GIFVIEW_FRAMESTORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+
+/** No frame at all. */
+#define FRAMESTORE_NONE SIZE_MAX
+
+/** Number of colors a FrameStore's palette can hold. */
+#define FRAMESTORE_PALETTE_SIZE 256
+
+
+/**
+ * How a FrameStore keeps its pixels, from most to least compact.  A store
+ * starts out indexed and moves down the list as the frames it's given need
+ * more colors, or transparency.
+ */
+enum FrameStore_Format
+{
+    /** One byte per pixel, indexing the store's palette. */
+    FrameStore_Format_Index8,
+    /** Opaque pixels, 16 bits each, losing the low bits of each channel. */
+    FrameStore_Format_RGB565,
+    /** Opaque pixels, as R, G, B bytes. */
+    FrameStore_Format_RGB24,
+    /** R, G, B, A bytes. */
+    FrameStore_Format_RGBA32,
+};
+
+/**
+ * One stored frame: the RECT of the canvas that changed since the frame
+ * before it, and the new pixels of that RECT in the store's format.  KEY is
+ * the index of the keyframe the frame is rebuilt from.  A keyframe is its own
+ * KEY, and its RECT is the whole canvas.  A frame identical to the one
+ * before it has an empty RECT and NULL PIXELS.  HASH is a hash of the whole
+ * frame.
+ *
+ * A frame identical to an earlier one other than the one before it is stored
+ * as a copy of it instead: COPY is the index of that frame, and the copy is
+ * its own KEY, with an empty RECT and NULL PIXELS.  For any other frame, COPY
+ * is FRAMESTORE_NONE.
+ *
+ * Once the store is compressed, PACKED holds the PACKED_SIZE byte compressed
+ * pixels, and PIXELS is NULL while the frame is cold.  Frames that don't
+ * compress are left with just their PIXELS.
+ */
+struct FrameStore_Frame
+{
+    size_t key;
+    size_t copy;
+    uint64_t hash;
+    SDL_Rect rect;
+    uint8_t *pixels;
+    uint8_t *packed;
+    size_t packed_size;
+};
+
+struct FrameStore_Cold;
+
+/**
+ * The COUNT full-canvas frames of an animation, WIDTH by HEIGHT pixels,
+ * stored as keyframes plus the rectangles that change in between.  There's a
+ * keyframe at least every INTERVAL frames.  BYTES is the size of all the
+ * stored pixels.
+ *
+ * Frames are stored in FORMAT.  While they're indexed, PALETTE holds the
+ * PALETTE_COUNT RGBA colors used so far, and SLOTS is a hash table of their
+ * indices plus one, 0 being an empty slot.  OPAQUE is true if none of the
+ * frames have any transparency.  If LOSSY is true, opaque frames with too
+ * many colors for the palette are stored as RGB565 rather than RGB24.
+ *
+ * ORIGINALS is a hash table of ORIGINALS_CAPACITY slots, ORIGINALS_COUNT of
+ * them used, mapping frame hashes to the index plus one of the latest frame
+ * with that hash that new frames can be copies of, 0 being an empty slot.
+ *
+ * CANVAS holds frame CURRENT as RGBA pixels.  While frames are being added,
+ * it holds the last one added, and CURRENT is FRAMESTORE_NONE.
+ *
+ * COLD is NULL unless the store has been compressed (see
+ * framestore_compress), in which case BYTES counts compressed frames at
+ * their compressed size.
+ */
+struct FrameStore
+{
+    int width, height;
+    size_t interval;
+
+    struct FrameStore_Frame *frames;
+    size_t count, capacity;
+    size_t bytes;
+
+    enum FrameStore_Format format;
+    uint32_t palette[FRAMESTORE_PALETTE_SIZE];
+    size_t palette_count;
+    uint16_t slots[2 * FRAMESTORE_PALETTE_SIZE];
+    bool opaque;
+    bool lossy;
+
+    size_t *originals;
+    size_t originals_count, originals_capacity;
+
+    uint32_t *canvas;
+    size_t current;
+
+    struct FrameStore_Cold *cold;
+};
+
+
+/**
+ * Create an empty store for WIDTH by HEIGHT frames, with a keyframe at least
+ * every INTERVAL frames.  If LOSSY is true, opaque frames may lose color
+ * precision to save space.
+ */
+struct FrameStore framestore_new(
+    int width, int height, size_t interval, bool lossy);
+
+/**
+ * Add a frame to the end of STORE.  PIXELS holds the whole RGBA frame, each
+ * row PITCH bytes after the last.  If KEY is true, the frame is stored as a
+ * keyframe, otherwise only what changed since the last frame is kept.  If
+ * the frame can't be stored in STORE's format, every frame is converted to
+ * one that can hold it first.  A frame identical to an earlier one is stored
+ * as a copy of it, costing nothing.  Leaves the new frame in STORE's canvas.
+ */
+void framestore_push(
+    struct FrameStore *restrict store,
+    uint32_t const *restrict pixels, size_t pitch,
+    bool key);
+
+/**
+ * Returns true if the frame PIXELS, each row PITCH bytes after the last, is
+ * the same as the last frame added to STORE.
+ */
+bool framestore_is_unchanged(
+    struct FrameStore const *restrict store,
+    uint32_t const *restrict pixels, size_t pitch);
+
+/**
+ * Change STORE's canvas to frame INDEX, starting from the nearest keyframe
+ * if need be.  Stored pixels are expanded to RGBA as they're drawn.  The part
+ * of the canvas that was rewritten is returned in CHANGED, which is empty if
+ * it was already on INDEX.
+ */
+void framestore_seek(
+    struct FrameStore *restrict store, size_t index,
+    SDL_Rect *restrict changed);
+
+/**
+ * Compress the frames of STORE, keeping only those near the last frame sought
+ * to decompressed.  After that, a worker thread decompresses the frames up
+ * to AHEAD past the one last sought ahead of time, and frames falling behind
+ * are dropped back to just their compressed copy.  No more frames can be
+ * added once a store is compressed.
+ */
+void framestore_compress(struct FrameStore *store, size_t ahead);
+
+/** Get the name of FORMAT. */
+char const *framestore_format_name(enum FrameStore_Format format);
+
+/** Free a FrameStore. */
+void framestore_free(struct FrameStore store);
+
+
+#endif /* GIFVIEW_FRAMESTORE_H */
@@ -0,0 +1,269 @@
+/*
+ * alloc.c -- Memory allocation within the gif library.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* For MAP_ANONYMOUS. */
+#define _DEFAULT_SOURCE
+
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !_WIN32
+#include <sys/mman.h>
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+#endif
+
+
+/** Size of the first block of each of a GIF's arenas. */
+#define PIXELS_FIRST_BLOCK_SIZE         (1024 * 1024)
+#define COLOR_TABLES_FIRST_BLOCK_SIZE   (4 * 1024)
+#define EXTENSIONS_FIRST_BLOCK_SIZE     (4 * 1024)
+#define METADATA_FIRST_BLOCK_SIZE       (16 * 1024)
+
+/** Pixel buffers are aligned to cache lines, to suit the pixel kernels. */
+#define PIXELS_ALIGNMENT    64
+
+
+/* ===[ Default Allocator ]=== */
+void *default_alloc(void *user, size_t size, enum GIF_AllocCategory category)
+{
+    (void)user;
+#if !_WIN32
+    /* Pixels only come in big blocks, which are best mapped by themselves so
+     * they go straight back to the OS when freed. */
+    if (category == GIF_AllocCategory_Pixels)
+    {
+        void *const mapping = mmap(
+            NULL, size,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return mapping == MAP_FAILED? NULL : mapping;
+    }
+#endif
+    return malloc(size);
+}
+
+void default_free(
+    void *user, void *ptr, size_t size, enum GIF_AllocCategory category)
+{
+    (void)user;
+#if !_WIN32
+    if (category == GIF_AllocCategory_Pixels)
+    {
+        if (ptr != NULL)
+            munmap(ptr, size);
+        return;
+    }
+#endif
+    free(ptr);
+}
+
+void *default_realloc(
+    void *user, void *ptr, size_t old_size, size_t new_size,
+    enum GIF_AllocCategory category)
+{
+    if (category != GIF_AllocCategory_Pixels)
+        return realloc(ptr, new_size);
+
+    void *const moved = default_alloc(user, new_size, category);
+    if (moved != NULL && ptr != NULL)
+    {
+        memcpy(moved, ptr, old_size < new_size? old_size : new_size);
+        default_free(user, ptr, old_size, category);
+    }
+    return moved;
+}
+
+struct GIF_Allocator const gif_default_allocator = {
+    .alloc = default_alloc,
+    .realloc = default_realloc,
+    .free = default_free,
+    .user = NULL,
+};
+
+
+/* ===[ Counting Allocator ]=== */
+/** Atomically raise *PEAK to at least VALUE. */
+void counting_raise_peak(size_t *peak, size_t value)
+{
+    size_t current = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (
+        current < value
+        && !__atomic_compare_exchange_n(
+            peak, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/** Record SIZE bytes of CATEGORY memory being allocated in STATS. */
+void counting_add(
+    struct GIF_AllocStats *stats, size_t size,
+    enum GIF_AllocCategory category)
+{
+    __atomic_fetch_add(&stats->allocations, 1, __ATOMIC_RELAXED);
+    size_t const total = __atomic_add_fetch(
+        &stats->bytes, size, __ATOMIC_RELAXED);
+    size_t const in_category = __atomic_add_fetch(
+        &stats->category_bytes[category], size, __ATOMIC_RELAXED);
+    counting_raise_peak(&stats->peak_bytes, total);
+    counting_raise_peak(&stats->category_peak_bytes[category], in_category);
+}
+
+/** Record SIZE bytes of CATEGORY memory being freed in STATS. */
+void counting_remove(
+    struct GIF_AllocStats *stats, size_t size,
+    enum GIF_AllocCategory category)
+{
+    __atomic_fetch_add(&stats->frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&stats->bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(
+        &stats->category_bytes[category], size, __ATOMIC_RELAXED);
+}
+
+void *counting_alloc(void *user, size_t size, enum GIF_AllocCategory category)
+{
+    struct GIF_CountingAllocator *const counter = user;
+    struct GIF_Allocator const *const backing = counter->backing;
+    void *const ptr = backing->alloc(backing->user, size, category);
+    if (ptr != NULL)
+        counting_add(&counter->stats, size, category);
+    return ptr;
+}
+
+void *counting_realloc(
+    void *user, void *ptr, size_t old_size, size_t new_size,
+    enum GIF_AllocCategory category)
+{
+    struct GIF_CountingAllocator *const counter = user;
+    struct GIF_Allocator const *const backing = counter->backing;
+    void *const moved = backing->realloc(
+        backing->user, ptr, old_size, new_size, category);
+    if (moved != NULL)
+    {
+        if (ptr != NULL)
+            counting_remove(&counter->stats, old_size, category);
+        counting_add(&counter->stats, new_size, category);
+    }
+    return moved;
+}
+
+void counting_free(
+    void *user, void *ptr, size_t size, enum GIF_AllocCategory category)
+{
+    struct GIF_CountingAllocator *const counter = user;
+    struct GIF_Allocator const *const backing = counter->backing;
+    if (ptr == NULL)
+        return;
+    backing->free(backing->user, ptr, size, category);
+    counting_remove(&counter->stats, size, category);
+}
+
+void gif_counting_allocator_init(
+    struct GIF_CountingAllocator *restrict counter,
+    struct GIF_Allocator const *restrict backing)
+{
+    memset(counter, 0, sizeof(*counter));
+    counter->allocator = (struct GIF_Allocator){
+        .alloc = counting_alloc,
+        .realloc = counting_realloc,
+        .free = counting_free,
+        .user = counter,
+    };
+    counter->backing = backing? backing : &gif_default_allocator;
+}
+
+char const *gif_alloc_category_name(enum GIF_AllocCategory category)
+{
+    switch (category)
+    {
+    case GIF_AllocCategory_Pixels:      return "pixels";
+    case GIF_AllocCategory_ColorTables: return "color tables";
+    case GIF_AllocCategory_Extensions:  return "extensions";
+    case GIF_AllocCategory_Metadata:    return "metadata";
+    case GIF_AllocCategory_Scratch:     return "scratch";
+    case GIF_AllocCategory_Count:       break;
+    }
+    return "unknown";
+}
+
+
+/* ===[ Library Allocation ]=== */
+void *mem_alloc(
+    struct GIF_Allocator const *allocator,
+    size_t size, enum GIF_AllocCategory category)
+{
+    return allocator->alloc(allocator->user, size, category);
+}
+
+void *mem_realloc(
+    struct GIF_Allocator const *allocator,
+    void *ptr, size_t old_size, size_t new_size,
+    enum GIF_AllocCategory category)
+{
+    return allocator->realloc(
+        allocator->user, ptr, old_size, new_size, category);
+}
+
+void mem_free(
+    struct GIF_Allocator const *allocator,
+    void *ptr, size_t size, enum GIF_AllocCategory category)
+{
+    if (ptr != NULL)
+        allocator->free(allocator->user, ptr, size, category);
+}
+
+struct GIF_Memory *gif_memory_new(struct GIF_Allocator const *allocator)
+{
+    struct GIF_Memory *const memory = mem_alloc(
+        allocator, sizeof(*memory), GIF_AllocCategory_Metadata);
+    if (memory == NULL)
+        return NULL;
+    memory->allocator = *allocator;
+    memory->has_source = false;
+    allocator = &memory->allocator;
+    arena_init(
+        &memory->pixels, allocator, GIF_AllocCategory_Pixels,
+        PIXELS_FIRST_BLOCK_SIZE, PIXELS_ALIGNMENT);
+    arena_init(
+        &memory->color_tables, allocator, GIF_AllocCategory_ColorTables,
+        COLOR_TABLES_FIRST_BLOCK_SIZE, ARENA_DEFAULT_ALIGNMENT);
+    arena_init(
+        &memory->extensions, allocator, GIF_AllocCategory_Extensions,
+        EXTENSIONS_FIRST_BLOCK_SIZE, ARENA_DEFAULT_ALIGNMENT);
+    arena_init(
+        &memory->metadata, allocator, GIF_AllocCategory_Metadata,
+        METADATA_FIRST_BLOCK_SIZE, ARENA_DEFAULT_ALIGNMENT);
+    return memory;
+}
+
+void gif_memory_free(struct GIF_Memory *memory)
+{
+    if (memory == NULL)
+        return;
+    arena_free(&memory->pixels);
+    arena_free(&memory->color_tables);
+    arena_free(&memory->extensions);
+    arena_free(&memory->metadata);
+    if (memory->has_source)
+        filemap_close(&memory->source);
+    struct GIF_Allocator const allocator = memory->allocator;
+    mem_free(
+        &allocator, memory, sizeof(*memory), GIF_AllocCategory_Metadata);
+}
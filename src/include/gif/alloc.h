@@ -0,0 +1,80 @@
+/*
+ * alloc.h -- Memory allocation within the gif library.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_ALLOC_H
+#define GIFVIEW_ALLOC_H
+
+#include "gif.h"
+#include "arena.h"
+#include "filemap.h"
+
+#include <stddef.h>
+
+
+/**
+ * A GIF's memory: the allocator it was loaded with, and an arena for each
+ * category of memory the GIF holds on to.  If HAS_SOURCE is set, SOURCE is
+ * the file a lazily loaded GIF's images are decoded from.
+ */
+struct GIF_Memory
+{
+    struct GIF_Allocator allocator;
+    struct Arena pixels, color_tables, extensions, metadata;
+    bool has_source;
+    struct FileMap source;
+};
+
+
+/**
+ * Allocate SIZE bytes of CATEGORY memory with ALLOCATOR.  Returns NULL if
+ * there's no memory left.
+ */
+void *mem_alloc(
+    struct GIF_Allocator const *allocator,
+    size_t size, enum GIF_AllocCategory category);
+
+/**
+ * Resize PTR, allocated with ALLOCATOR, from OLD_SIZE to NEW_SIZE bytes.  PTR
+ * may be NULL.  Returns NULL if there's no memory left, in which case PTR is
+ * left as it was.
+ */
+void *mem_realloc(
+    struct GIF_Allocator const *allocator,
+    void *ptr, size_t old_size, size_t new_size,
+    enum GIF_AllocCategory category);
+
+/** Free PTR, of SIZE bytes, allocated with ALLOCATOR.  PTR may be NULL. */
+void mem_free(
+    struct GIF_Allocator const *allocator,
+    void *ptr, size_t size, enum GIF_AllocCategory category);
+
+/**
+ * Create the memory for a new GIF, which will come from ALLOCATOR.  Returns
+ * NULL if there's no memory left.
+ */
+struct GIF_Memory *gif_memory_new(struct GIF_Allocator const *allocator);
+
+/**
+ * Free MEMORY, and everything in its arenas, and close its source file.
+ * MEMORY may be NULL.
+ */
+void gif_memory_free(struct GIF_Memory *memory);
+
+
+#endif /* GIFVIEW_ALLOC_H */
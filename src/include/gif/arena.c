@@ -0,0 +1,157 @@
+/*
+ * arena.c -- Region-based memory allocation.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "arena.h"
+#include "alloc.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Blocks stop doubling in size once they reach this. */
+#define ARENA_MAX_BLOCK_SIZE    (64 * 1024 * 1024)
+
+
+/**
+ * One block of an arena.  The block's memory starts with this header, and is
+ * SIZE bytes long, of which the first USED are taken.  NEXT is the block that
+ * was allocated before this one.
+ */
+struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size, used;
+};
+
+
+/** Round SIZE up to a multiple of ALIGNMENT, which is a power of 2. */
+size_t arena_align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Carve SIZE bytes aligned to ALIGNMENT out of BLOCK.  Returns NULL if they
+ * don't fit, or if there's no BLOCK.
+ */
+void *arena_block_alloc(
+    struct ArenaBlock *block, size_t size, size_t alignment)
+{
+    if (block == NULL)
+        return NULL;
+    uintptr_t const base = (uintptr_t)block;
+    uintptr_t const start = arena_align_up(base + block->used, alignment);
+    if (start - base > block->size || size > block->size - (start - base))
+        return NULL;
+    block->used = (start - base) + size;
+    return (void *)start;
+}
+
+
+void arena_init(
+    struct Arena *restrict arena,
+    struct GIF_Allocator const *restrict allocator,
+    enum GIF_AllocCategory category,
+    size_t first_block_size, size_t alignment)
+{
+    arena->blocks = NULL;
+    arena->next_size = first_block_size;
+    arena->alignment = alignment;
+    arena->allocator = allocator;
+    arena->category = category;
+}
+
+void *arena_alloc(struct Arena *arena, size_t size)
+{
+    void *ptr = arena_block_alloc(arena->blocks, size, arena->alignment);
+    if (ptr != NULL)
+        return ptr;
+
+    /* Doesn't fit, so start a new block.  Allocations too big for the next
+     * block get one to themselves. */
+    size_t block_size = arena->next_size;
+    size_t const needed = sizeof(struct ArenaBlock) + arena->alignment + size;
+    if (needed < size)
+        return NULL;
+    if (block_size < needed)
+        block_size = needed;
+
+    struct ArenaBlock *const block = mem_alloc(
+        arena->allocator, block_size, arena->category);
+    if (block == NULL)
+        return NULL;
+    if (block_size == arena->next_size
+        && arena->next_size < ARENA_MAX_BLOCK_SIZE)
+    {
+        arena->next_size *= 2;
+    }
+    block->next = arena->blocks;
+    block->size = block_size;
+    block->used = sizeof(*block);
+    arena->blocks = block;
+    return arena_block_alloc(block, size, arena->alignment);
+}
+
+void *arena_realloc(
+    struct Arena *arena, void *ptr, size_t old_size, size_t new_size)
+{
+    if (ptr != NULL)
+    {
+        /* The last allocation in the newest block can just be extended. */
+        struct ArenaBlock *const block = arena->blocks;
+        uintptr_t const base = (uintptr_t)block;
+        uintptr_t const start = (uintptr_t)ptr;
+        bool const last = (
+            start > base && start - base + old_size == block->used);
+        if (last && new_size <= block->size - (start - base))
+        {
+            block->used = start - base + new_size;
+            return ptr;
+        }
+    }
+
+    void *const moved = arena_alloc(arena, new_size);
+    if (moved == NULL)
+        return NULL;
+    if (ptr != NULL)
+        memcpy(moved, ptr, old_size < new_size? old_size : new_size);
+    return moved;
+}
+
+char *arena_strndup(struct Arena *arena, void const *s, size_t n)
+{
+    char *const out = arena_alloc(arena, n + 1);
+    if (out == NULL)
+        return NULL;
+    memcpy(out, s, n);
+    out[n] = '\0';
+    return out;
+}
+
+void arena_free(struct Arena *arena)
+{
+    for (struct ArenaBlock *block = arena->blocks; block != NULL;)
+    {
+        struct ArenaBlock *const next = block->next;
+        mem_free(arena->allocator, block, block->size, arena->category);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
@@ -0,0 +1,87 @@
+/*
+ * arena.h -- Region-based memory allocation.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_ARENA_H
+#define GIFVIEW_ARENA_H
+
+#include "gif.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/** Alignment of allocations from an arena, unless it asks for more. */
+#define ARENA_DEFAULT_ALIGNMENT 16
+
+
+/**
+ * A region of memory that allocations are carved out of in order, and which
+ * is freed all at once.  It's made of a few large blocks, each twice the size
+ * of the last, so freeing it takes only a handful of calls no matter how many
+ * allocations were made.
+ *
+ * BLOCKS lists the arena's blocks, newest first; allocations are made from
+ * the newest.  NEXT_SIZE is the size of the block to allocate when the newest
+ * one fills up.  Blocks come from ALLOCATOR, as CATEGORY memory, and
+ * allocations are aligned to ALIGNMENT.
+ */
+struct Arena
+{
+    struct ArenaBlock *blocks;
+    size_t next_size;
+    size_t alignment;
+    struct GIF_Allocator const *allocator;
+    enum GIF_AllocCategory category;
+};
+
+
+/**
+ * Set up an empty ARENA.  Its first block, of FIRST_BLOCK_SIZE bytes, isn't
+ * allocated until it's needed.  ALIGNMENT must be a power of 2.
+ */
+void arena_init(
+    struct Arena *restrict arena,
+    struct GIF_Allocator const *restrict allocator,
+    enum GIF_AllocCategory category,
+    size_t first_block_size, size_t alignment);
+
+/** Allocate SIZE bytes from ARENA.  Returns NULL if there's no memory left. */
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/**
+ * Resize the allocation PTR of OLD_SIZE bytes from ARENA to NEW_SIZE bytes.
+ * If PTR was the last allocation made and there's room, it's grown in place;
+ * otherwise its contents are moved to a new allocation, and the old one is
+ * wasted until the arena is freed.  PTR may be NULL.  Returns NULL if there's
+ * no memory left, in which case PTR is left as it was.
+ */
+void *arena_realloc(
+    struct Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Copy the N bytes at S into a new, NUL-terminated string in ARENA.  Returns
+ * NULL if there's no memory left.
+ */
+char *arena_strndup(struct Arena *arena, void const *s, size_t n);
+
+/** Free everything allocated from ARENA, leaving it empty. */
+void arena_free(struct Arena *arena);
+
+
+#endif /* GIFVIEW_ARENA_H */
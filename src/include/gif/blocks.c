@@ -0,0 +1,64 @@
+/*
+ * blocks.c -- GIF block structure definitions, shared by the loader and the
+ * index scanner.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "blocks.h"
+
+#include <string.h>
+
+
+size_t next_data_sub_block(uint8_t const *data, size_t size, size_t *pos)
+{
+    if (*pos >= size)
+        return 0;
+    size_t block_size = data[(*pos)++];
+    if (block_size > size - *pos)
+        block_size = size - *pos;
+    return block_size;
+}
+
+size_t peek_data_sub_blocks(
+    uint8_t const *restrict data, size_t size, size_t pos,
+    uint8_t *restrict out, size_t n)
+{
+    size_t copied = 0;
+    while (copied < n)
+    {
+        size_t block_size = next_data_sub_block(data, size, &pos);
+        if (block_size == 0)
+            break;
+        if (block_size > n - copied)
+            block_size = n - copied;
+        memcpy(out + copied, data + pos, block_size);
+        copied += block_size;
+        pos += block_size;
+    }
+    return copied;
+}
+
+size_t extension_min_size(uint8_t label)
+{
+    switch (label)
+    {
+    case GIF_Ext_PlainText:             return 12;
+    case GIF_Ext_GraphicControl:        return 4;
+    case GIF_Ext_ApplicationExtension:  return 11;
+    default:                            return 0;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * blocks.h -- GIF block structure declarations, shared by the loader and the
+ * index scanner.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_BLOCKS_H
+#define GIFVIEW_BLOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+enum GIF_BlockIdentifiers
+{
+    GIF_ExtensionIntroducer = 0x21,
+    GIF_ImageSeparator = 0x2C,
+    GIF_Trailer = 0x3B,
+};
+
+enum GIF_ExtensionBlockLabels
+{
+    GIF_Ext_PlainText = 0x01,
+    GIF_Ext_GraphicControl = 0xF9,
+    GIF_Ext_Comment = 0xFE,
+    GIF_Ext_ApplicationExtension = 0xFF
+};
+
+
+/**
+ * Find the next data sub-block in the SIZE bytes of DATA, starting at *POS.
+ * Returns the block's size (0 for the block terminator, or when the data runs
+ * out) and moves *POS to the first byte of the block.  Blocks which are cut
+ * short by the end of the data are shortened to fit.
+ */
+size_t next_data_sub_block(uint8_t const *data, size_t size, size_t *pos);
+
+/**
+ * Copy up to N bytes of the data sub-blocks starting at POS in the SIZE bytes
+ * of DATA into OUT, as if the blocks were one.  Returns the number of bytes
+ * copied, which is less than N if the blocks hold less.
+ */
+size_t peek_data_sub_blocks(
+    uint8_t const *restrict data, size_t size, size_t pos,
+    uint8_t *restrict out, size_t n);
+
+/**
+ * Get the fewest bytes of data an extension with LABEL needs to be used.
+ * Extensions with less are skipped, rather than treated as errors, since
+ * real-world files have them.
+ */
+size_t extension_min_size(uint8_t label);
+
+
+#endif /* GIFVIEW_BLOCKS_H */
@@ -0,0 +1,151 @@
+/*
+ * filemap.c -- Read-only file mapping.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "filemap.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !_WIN32
+#include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+
+/**
+ * Size of the reads used when a file has to be copied into memory.  The
+ * buffer grows geometrically from a few of these.
+ */
+#define FILEMAP_READ_SIZE   (64 * 1024)
+
+
+/** Read the rest of FD into MAP.  Returns false on failure. */
+bool filemap_read(struct FileMap *map, int fd)
+{
+    uint8_t *data = NULL;
+    size_t size = 0, allocated = 0;
+    for(;;)
+    {
+        if (allocated - size < FILEMAP_READ_SIZE)
+        {
+            allocated = allocated? 2 * allocated : 4 * FILEMAP_READ_SIZE;
+            uint8_t *const grown = realloc(data, allocated);
+            if (grown == NULL)
+            {
+                free(data);
+                errno = ENOMEM;
+                return false;
+            }
+            data = grown;
+        }
+
+        ssize_t const n = read(fd, data + size, allocated - size);
+        if (n == 0)
+            break;
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            int const saved_errno = errno;
+            free(data);
+            errno = saved_errno;
+            return false;
+        }
+        size += n;
+    }
+    map->data = data;
+    map->size = size;
+    map->mapped = false;
+    return true;
+}
+
+bool filemap_from_fd(struct FileMap *map, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return false;
+    bool const regular = S_ISREG(st.st_mode);
+
+#if !_WIN32
+    /* Map from the current position, so FD behaves the same whether it's
+     * mapped or read.  Mappings have to start on a page boundary. */
+    off_t const offset = regular? lseek(fd, 0, SEEK_CUR) : -1;
+    if (regular && offset >= 0 && offset < st.st_size)
+    {
+        off_t const page = sysconf(_SC_PAGESIZE);
+        off_t const start = offset - offset % page;
+        size_t const length = st.st_size - start;
+        uint8_t *const data = mmap(
+            NULL, length, PROT_READ, MAP_PRIVATE, fd, start);
+        if (data != MAP_FAILED)
+        {
+            /* The parser touches every page while skipping through the data
+             * sub-blocks, so have the kernel start reading them all now. */
+            posix_madvise(data, length, POSIX_MADV_WILLNEED);
+            lseek(fd, st.st_size, SEEK_SET);
+            map->data = data + (offset - start);
+            map->size = st.st_size - offset;
+            map->mapped = true;
+            map->mapping = data;
+            map->mapping_size = length;
+            return true;
+        }
+    }
+
+    /* Can't be mapped, so fall back to reading it.  Regular files will be
+     * read straight through. */
+    if (regular)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    (void)regular;
+#endif
+    return filemap_read(map, fd);
+}
+
+bool filemap_open(struct FileMap *restrict map, char const *restrict filename)
+{
+    int const fd = open(filename, O_RDONLY | O_BINARY);
+    if (fd == -1)
+        return false;
+    bool const ok = filemap_from_fd(map, fd);
+    int const saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return ok;
+}
+
+void filemap_close(struct FileMap *map)
+{
+#if !_WIN32
+    if (map->mapped)
+    {
+        munmap(map->mapping, map->mapping_size);
+        return;
+    }
+#endif
+    free((void *)map->data);
+}
@@ -0,0 +1,61 @@
+/*
+ * filemap.h -- Read-only file mapping.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_FILEMAP_H
+#define GIFVIEW_FILEMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * A file's contents, held in memory.  Where possible the file is mapped
+ * rather than copied, so DATA may be backed by the file itself.  MAPPED says
+ * whether it is, in which case MAPPING and MAPPING_SIZE describe the whole
+ * mapping, which DATA lies at the end of.
+ */
+struct FileMap
+{
+    uint8_t const *data;
+    size_t size;
+    bool mapped;
+    void *mapping;
+    size_t mapping_size;
+};
+
+
+/**
+ * Load FILENAME into MAP.  Regular files are mapped; anything that can't be
+ * mapped is read into a buffer instead.  Returns false and sets errno if the
+ * file can't be read.
+ */
+bool filemap_open(struct FileMap *restrict map, char const *restrict filename);
+
+/**
+ * Load the rest of the file open as FD into MAP, like filemap_open.  Pipes and
+ * terminals are read until end of file.  FD is left open.
+ */
+bool filemap_from_fd(struct FileMap *map, int fd);
+
+/** Release the memory held by MAP. */
+void filemap_close(struct FileMap *map);
+
+
+#endif /* GIFVIEW_FILEMAP_H */
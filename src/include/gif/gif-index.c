@@ -0,0 +1,429 @@
+/*
+ * gif-index.c -- Index a GIF without decoding it.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gif.h"
+#include "blocks.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Walks the block structure of the SIZE bytes of DATA, from POS, following
+ * the block rules in blocks.h that gif-load.c uses too, and fills in INDEX.
+ * GEXTS is a stack of Graphic Control Extensions waiting for the graphic they
+ * control.
+ */
+struct Scanner
+{
+    uint8_t const *data;
+    size_t size, pos;
+    struct GIF_Index *index;
+    size_t entries_allocated, comments_allocated;
+    struct GIF_GraphicExt *gexts;
+    size_t gext_count, gexts_allocated;
+};
+
+
+/** Returns true if N more bytes of S's data are available. */
+bool scanner_has(struct Scanner const *s, size_t n)
+{
+    return s->size - s->pos >= n;
+}
+
+/** Read a little-endian 16-bit value at S's position. */
+uint16_t scanner_u16(struct Scanner *s)
+{
+    uint16_t const value = s->data[s->pos] | (s->data[s->pos + 1] << 8);
+    s->pos += 2;
+    return value;
+}
+
+/**
+ * Copy the next N bytes of S's data to OUT and move past them.  If the data
+ * ends first, the rest of OUT is zeroed, as the loader reads it, and false is
+ * returned.
+ */
+bool scanner_read(struct Scanner *restrict s, uint8_t *restrict out, size_t n)
+{
+    size_t const available = s->size - s->pos;
+    bool const ok = n <= available;
+    if (!ok)
+    {
+        memset(out + available, 0, n - available);
+        n = available;
+    }
+    memcpy(out, s->data + s->pos, n);
+    s->pos += n;
+    return ok;
+}
+
+/**
+ * Skip past the data sub-blocks at S's position, up to and including the
+ * block terminator.  Returns false if the data ends first.
+ */
+bool scanner_skip_sub_blocks(struct Scanner *s)
+{
+    for(;;)
+    {
+        if (!scanner_has(s, 1))
+            return false;
+        size_t const block_size = next_data_sub_block(
+            s->data, s->size, &s->pos);
+        if (block_size == 0)
+            return true;
+        s->pos += block_size;
+    }
+}
+
+/**
+ * Add a new, zeroed entry to S's index, and return it.  Returns NULL if
+ * there's no memory left.
+ */
+struct GIF_IndexEntry *scanner_add_entry(struct Scanner *s)
+{
+    struct GIF_Index *const index = s->index;
+    if (index->count == s->entries_allocated)
+    {
+        size_t const allocated = (
+            s->entries_allocated? 2 * s->entries_allocated : 64);
+        struct GIF_IndexEntry *const entries = realloc(
+            index->entries, allocated * sizeof(*index->entries));
+        if (entries == NULL)
+            return NULL;
+        index->entries = entries;
+        s->entries_allocated = allocated;
+    }
+    struct GIF_IndexEntry *const entry = &index->entries[index->count++];
+    memset(entry, 0, sizeof(*entry));
+    return entry;
+}
+
+/**
+ * Record that a comment's sub-blocks start at OFFSET.  Returns false if
+ * there's no memory left.
+ */
+bool scanner_add_comment(struct Scanner *s, size_t offset)
+{
+    struct GIF_Index *const index = s->index;
+    if (index->comment_count == s->comments_allocated)
+    {
+        size_t const allocated = (
+            s->comments_allocated? 2 * s->comments_allocated : 4);
+        size_t *const offsets = realloc(
+            index->comment_offsets,
+            allocated * sizeof(*index->comment_offsets));
+        if (offsets == NULL)
+            return false;
+        index->comment_offsets = offsets;
+        s->comments_allocated = allocated;
+    }
+    index->comment_offsets[index->comment_count++] = offset;
+    return true;
+}
+
+/**
+ * Push GEXT onto S's Graphic Control Extension stack.  Returns false if
+ * there's no memory left.
+ */
+bool scanner_push_gext(struct Scanner *s, struct GIF_GraphicExt gext)
+{
+    if (s->gext_count == s->gexts_allocated)
+    {
+        size_t const allocated = (
+            s->gexts_allocated? 2 * s->gexts_allocated : 4);
+        struct GIF_GraphicExt *const gexts = realloc(
+            s->gexts, allocated * sizeof(*s->gexts));
+        if (gexts == NULL)
+            return false;
+        s->gexts = gexts;
+        s->gexts_allocated = allocated;
+    }
+    s->gexts[s->gext_count++] = gext;
+    return true;
+}
+
+/**
+ * Pop the most recent Graphic Control Extension from S's stack into ENTRY,
+ * like parser_pop_gext does for the parser.
+ */
+void scanner_pop_gext(struct Scanner *s, struct GIF_IndexEntry *entry)
+{
+    if (s->gext_count == 0)
+        return;
+    entry->has_extension = true;
+    entry->extension = s->gexts[--s->gext_count];
+}
+
+/**
+ * Read the color table flag, size and position from the packed FIELDS of a
+ * descriptor, and skip past the table.  Returns false if the data ends first.
+ */
+bool scanner_skip_color_table(
+    struct Scanner *restrict s,
+    bool flag, uint8_t exponent,
+    size_t *restrict offset, size_t *restrict size)
+{
+    *offset = 0;
+    *size = 0;
+    if (!flag)
+        return true;
+    size_t const colors = (size_t)1 << (exponent + 1);
+    if (!scanner_has(s, 3 * colors))
+        return false;
+    *offset = s->pos;
+    *size = colors;
+    s->pos += 3 * colors;
+    return true;
+}
+
+
+/* ===[ Blocks ]=== */
+/** Scan the Header and Logical Screen Descriptor. */
+bool scan_header(struct Scanner *s)
+{
+    struct GIF_Index *const index = s->index;
+    if (!scanner_has(s, 13) || memcmp(s->data, "GIF", 3) != 0)
+        return false;
+
+    index->version = GIF_Version_Unknown;
+    if (memcmp(s->data + 3, "87a", 3) == 0)
+        index->version = GIF_Version_87a;
+    else if (memcmp(s->data + 3, "89a", 3) == 0)
+        index->version = GIF_Version_89a;
+    s->pos = 6;
+
+    index->width = scanner_u16(s);
+    index->height = scanner_u16(s);
+    uint8_t const fields = s->data[s->pos];
+    index->bg_color_index = s->data[s->pos + 1];
+    s->pos += 3;
+    return scanner_skip_color_table(
+        s, (fields >> 7) & 1, fields & 7,
+        &index->color_table_offset, &index->color_table_size);
+}
+
+/**
+ * If the application extension with the SIZE bytes of DATA is a looping
+ * extension, record its loop count in S.
+ */
+void scan_loop_count(
+    struct Scanner *restrict s, uint8_t const *restrict data, size_t size)
+{
+    /* The 11 byte identifier, then a sub-block ID of 1 and the count. */
+    if (size < 14)
+        return;
+    if (memcmp(data, "NETSCAPE2.0", 11) != 0
+            && memcmp(data, "ANIMEXTS1.0", 11) != 0)
+        return;
+    if (data[11] != 1)
+        return;
+    s->index->loop_count = data[12] | (data[13] << 8);
+}
+
+/**
+ * Scan an Extension, after its introducer.  Extensions are checked with the
+ * same rules the loader uses, from blocks.h, so the index and the loaded GIF
+ * agree on which ones count.
+ */
+bool scan_extension(struct Scanner *s)
+{
+    if (!scanner_has(s, 1))
+        return false;
+    uint8_t const label = s->data[s->pos++];
+    size_t const start = s->pos;
+
+    /* Enough of the data to read any extension's fixed fields. */
+    uint8_t head[14];
+    size_t const head_size = peek_data_sub_blocks(
+        s->data, s->size, start, head, sizeof(head));
+    bool const usable = head_size >= extension_min_size(label);
+    switch (label)
+    {
+    case GIF_Ext_GraphicControl:
+        if (usable)
+        {
+            struct GIF_GraphicExt const gext = {
+                .disposal_method = (head[0] >> 2) & 7,
+                .user_input_flag = (head[0] >> 1) & 1,
+                .transparent_color_flag = head[0] & 1,
+                .delay_time = head[1] | (head[2] << 8),
+                .transparent_color_idx = head[3],
+            };
+            if (!scanner_push_gext(s, gext))
+                return false;
+        }
+        break;
+
+    case GIF_Ext_PlainText:
+        if (usable)
+        {
+            struct GIF_IndexEntry *const entry = scanner_add_entry(s);
+            if (entry == NULL)
+                return false;
+            entry->is_img = false;
+            entry->left = head[0] | (head[1] << 8);
+            entry->top = head[2] | (head[3] << 8);
+            entry->width = head[4] | (head[5] << 8);
+            entry->height = head[6] | (head[7] << 8);
+            entry->data_offset = start;
+            scanner_pop_gext(s, entry);
+            if (!scanner_skip_sub_blocks(s))
+                return false;
+            entry->data_size = s->pos - start;
+            return true;
+        }
+        break;
+
+    case GIF_Ext_Comment:
+        if (!scanner_add_comment(s, start))
+            return false;
+        break;
+
+    case GIF_Ext_ApplicationExtension:
+        if (usable)
+        {
+            s->index->app_extension_count++;
+            scan_loop_count(s, head, head_size);
+        }
+        break;
+
+    default:
+        return false;
+    }
+    return scanner_skip_sub_blocks(s);
+}
+
+/**
+ * Scan an Image Descriptor and its data, after the image separator.  The
+ * loader makes a graphic of an image cut short anywhere past its separator,
+ * so it gets an entry here too, with a cut off color table left out.
+ */
+bool scan_image(struct Scanner *s)
+{
+    struct GIF_IndexEntry *const entry = scanner_add_entry(s);
+    if (entry == NULL)
+        return false;
+    uint8_t descriptor[9];
+    bool const whole = scanner_read(s, descriptor, sizeof(descriptor));
+    entry->is_img = true;
+    entry->left = descriptor[0] | (descriptor[1] << 8);
+    entry->top = descriptor[2] | (descriptor[3] << 8);
+    entry->width = descriptor[4] | (descriptor[5] << 8);
+    entry->height = descriptor[6] | (descriptor[7] << 8);
+    uint8_t const fields = descriptor[8];
+    entry->interlace_flag = (fields >> 6) & 1;
+    scanner_pop_gext(s, entry);
+    if (!whole)
+        return false;
+    if (!scanner_skip_color_table(
+            s, (fields >> 7) & 1, fields & 7,
+            &entry->color_table_offset, &entry->color_table_size))
+        return false;
+
+    /* LZW minimum code size, then the data sub-blocks. */
+    entry->data_offset = s->pos;
+    if (!scanner_has(s, 1))
+        return false;
+    s->pos += 1;
+    if (!scanner_skip_sub_blocks(s))
+        return false;
+    entry->data_size = s->pos - entry->data_offset;
+    return true;
+}
+
+
+bool gif_index_scan(
+    void const *restrict data, size_t size, struct GIF_Index *restrict index)
+{
+    memset(index, 0, sizeof(*index));
+    index->loop_count = -1;
+    struct Scanner s = {
+        .data = data,
+        .size = size,
+        .pos = 0,
+        .index = index,
+        .entries_allocated = 0,
+        .comments_allocated = 0,
+        .gexts = NULL,
+        .gext_count = 0,
+        .gexts_allocated = 0,
+    };
+
+    bool ok = scan_header(&s);
+    while (ok && scanner_has(&s, 1))
+    {
+        uint8_t const byte = s.data[s.pos++];
+        if (byte == GIF_Trailer)
+        {
+            index->complete = true;
+            break;
+        }
+        else if (byte == GIF_ExtensionIntroducer)
+            ok = scan_extension(&s);
+        else if (byte == GIF_ImageSeparator)
+            ok = scan_image(&s);
+        else
+            ok = false;
+    }
+
+    free(s.gexts);
+    return index->complete;
+}
+
+char *gif_index_comment(void const *data, size_t size, size_t offset)
+{
+    uint8_t const *const bytes = data;
+
+    /* Add up the sub-blocks first, so the string is only allocated once. */
+    size_t length = 0;
+    for (size_t pos = offset; pos < size && bytes[pos] != 0;)
+    {
+        size_t const block_size = bytes[pos++];
+        size_t const available = size - pos;
+        length += block_size < available? block_size : available;
+        pos += block_size;
+    }
+
+    char *const comment = malloc(length + 1);
+    if (comment == NULL)
+        return NULL;
+    size_t written = 0;
+    for (size_t pos = offset; written < length;)
+    {
+        size_t block_size = bytes[pos++];
+        if (block_size > length - written)
+            block_size = length - written;
+        memcpy(comment + written, bytes + pos, block_size);
+        written += block_size;
+        pos += block_size;
+    }
+    comment[length] = '\0';
+    return comment;
+}
+
+void gif_index_free(struct GIF_Index *index)
+{
+    free(index->entries);
+    free(index->comment_offsets);
+    index->entries = NULL;
+    index->comment_offsets = NULL;
+    index->count = 0;
+    index->comment_count = 0;
+}
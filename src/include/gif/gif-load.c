@@ -26,16 +26,29 @@
  */
 
 #include "gif.h"
+#include "alloc.h"
+#include "blocks.h"
+#include "filemap.h"
 #include "lzw.h"
-#include "util.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdnoreturn.h>
 #include <string.h>
 
 
+/** Images with fewer pixels than this are never split between threads. */
+#define PARALLEL_DECODE_MIN_PIXELS  (1024 * 1024)
+
+/** Most colors a color table can have. */
+#define COLOR_TABLE_MAX_SIZE    256
+
+/** Longest message passed to the log callback, including the NUL. */
+#define LOG_MESSAGE_SIZE    256
+
+
 struct Parser;
 
 /**
@@ -53,38 +66,73 @@ typedef struct ParseState
 /**
  * GIF Parser state machine.
  *
- * Reads characters from STREAM according to STATE, building the RESULT as it
- * goes.  GEXT_STACK is used to store Graphic Control Extensions, as other
- * blocks can appear between them and the Graphic they control.
+ * Reads the SIZE bytes of DATA, starting from POS, according to STATE,
+ * building the RESULT as it goes.  GEXT_STACK is used to store Graphic
+ * Control Extensions, as other blocks can appear between them and the Graphic
+ * they control.  OPTIONS are the caller's load options.  JOBS lists the images
+ * which still need to be decoded once parsing is done.  The *_ALLOCATED
+ * fields hold the capacity of the matching arrays.  Everything in RESULT is
+ * allocated from the arenas in its memory, and the parser's own scratch
+ * memory comes from ALLOCATOR, the same allocator the arenas use.  STATUS is
+ * set by the first problem that stops parsing.  COLOR_TABLES is a hash set of
+ * the color tables loaded so far, with COLOR_TABLE_SLOTS slots (a power of 2)
+ * of which COLOR_TABLE_COUNT are in use, so repeated tables can be shared.
  */
 typedef struct Parser
 {
-    FILE *stream;
+    uint8_t const *data;
+    size_t size, pos;
     ParseState state;
-    LinkedList *gext_stack;
+    enum GIF_Status status;
+    struct GIF_GraphicExt **gext_stack;
+    size_t gext_count, gexts_allocated;
+    struct GIF_LoadOptions options;
     GIF result;
+    struct GIF_Allocator const *allocator;
+    size_t graphics_allocated, comments_allocated, app_extensions_allocated;
+    struct GIF_ColorTable **color_tables;
+    size_t color_table_slots, color_table_count;
+
+    struct DecodeJob *jobs;
+    size_t job_count, jobs_allocated;
 } Parser;
 
-struct GenericExtension
+/**
+ * An image whose data is decoded after parsing is done.  GRAPHIC is the
+ * image's index in the GIF's graphics, since the array may still move while
+ * parsing.  DATA points into the parser's data, at the image's LZW minimum
+ * code size byte, and covers the SIZE bytes up to the end of its data
+ * sub-blocks.
+ */
+struct DecodeJob
 {
-    uint8_t label;
-    size_t data_size;
-    uint8_t *data;
+    size_t graphic;
+    uint8_t const *data;
+    size_t size;
 };
 
-enum GIF_BlockIdentifiers
+/**
+ * Work queue shared by the decoding threads.  Each thread takes the next job
+ * in order until none are left.  Each job may use up to JOB_THREADS threads to
+ * decode a single large image.  OPTIONS are the caller's load options.
+ */
+struct DecodePool
 {
-    GIF_ExtensionIntroducer = 0x21,
-    GIF_ImageSeparator = 0x2C,
-    GIF_Trailer = 0x3B,
+    struct GIF_LoadOptions const *options;
+    struct GIF_Allocator const *allocator;
+    struct GIF_Graphic *graphics;
+    struct DecodeJob const *jobs;
+    size_t job_count;
+    unsigned int job_threads;
+    pthread_mutex_t lock;
+    size_t next_job;
 };
 
-enum GIF_ExtensionBlockLabels
+struct GenericExtension
 {
-    GIF_Ext_PlainText = 0x01,
-    GIF_Ext_GraphicControl = 0xF9,
-    GIF_Ext_Comment = 0xFE,
-    GIF_Ext_ApplicationExtension = 0xFF
+    uint8_t label;
+    size_t data_size;
+    uint8_t *data;
 };
 
 
@@ -105,62 +153,215 @@ static ParseState const
     STATE_FINISHED = {NULL, "Finished"};
 
 
-/* ===[ Parser Methods ]=== */
-/** Print parser error message and exit. */
-noreturn void parser_error(
-    Parser const *restrict p, char const *restrict fmt, ...)
+/* ===[ Logging ]=== */
+/**
+ * Pass the message formatted from FMT at LEVEL to the log callback in
+ * OPTIONS, if there is one.  Long messages are cut short.
+ */
+void load_log(
+    struct GIF_LoadOptions const *restrict options, enum GIF_LogLevel level,
+    char const *restrict fmt, ...)
 {
+    if (options->log == NULL)
+        return;
+    char message[LOG_MESSAGE_SIZE];
     va_list ap;
     va_start(ap, fmt);
-    char *fmt2 = NULL;
-    sprintfa(&fmt2, "GIF Parse Error: %s -- %s\n", p->state.name, fmt);
-    vfprintf(stderr, fmt2, ap);
-    free(fmt2);
+    vsnprintf(message, sizeof(message), fmt, ap);
     va_end(ap);
-    exit(EXIT_FAILURE);
+    options->log(options->log_user, level, message);
 }
 
-/** Free memory allocated to P. */
+
+/* ===[ Parser Methods ]=== */
+/**
+ * Stop parsing P because of STATUS, unless it's already been stopped.
+ * Returns the finished state, so state functions can return it directly.
+ */
+ParseState parser_stop(Parser *p, enum GIF_Status status)
+{
+    if (p->status == GIF_Status_OK)
+        p->status = status;
+    return STATE_FINISHED;
+}
+
+/**
+ * Log an error in P's data, and stop parsing, as with parser_stop.  Only the
+ * first problem found is logged, since the rest are likely caused by it.
+ */
+ParseState parser_error(Parser *restrict p, char const *restrict fmt, ...)
+{
+    if (p->status == GIF_Status_OK && p->options.log != NULL)
+    {
+        char message[LOG_MESSAGE_SIZE];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(message, sizeof(message), fmt, ap);
+        va_end(ap);
+        load_log(
+            &p->options, GIF_LogLevel_Error, "%s -- %s",
+            p->state.name, message);
+    }
+    return parser_stop(p, GIF_Status_Malformed);
+}
+
+/** Stop parsing P because its data ended early. */
+ParseState parser_truncated(Parser *p)
+{
+    if (p->status == GIF_Status_OK)
+    {
+        load_log(
+            &p->options, GIF_LogLevel_Error, "%s -- unexpected end of data",
+            p->state.name);
+    }
+    return parser_stop(p, GIF_Status_Truncated);
+}
+
+/** Stop parsing P because the allocator ran out of memory. */
+ParseState parser_out_of_memory(Parser *p)
+{
+    if (p->status == GIF_Status_OK)
+    {
+        load_log(
+            &p->options, GIF_LogLevel_Error, "%s -- out of memory",
+            p->state.name);
+    }
+    return parser_stop(p, GIF_Status_OutOfMemory);
+}
+
+/**
+ * Free memory allocated to P.  Graphic Control Extensions left on the stack
+ * are in the result's arena, so they go with it.
+ */
 void parser_free(Parser *p)
 {
-    LinkedList *node = p->gext_stack;
-    while (node)
+    mem_free(
+        p->allocator, p->gext_stack,
+        p->gexts_allocated * sizeof(*p->gext_stack),
+        GIF_AllocCategory_Scratch);
+    mem_free(
+        p->allocator, p->jobs, p->jobs_allocated * sizeof(*p->jobs),
+        GIF_AllocCategory_Scratch);
+    mem_free(
+        p->allocator, p->color_tables,
+        p->color_table_slots * sizeof(*p->color_tables),
+        GIF_AllocCategory_Scratch);
+}
+
+/**
+ * Make sure ARRAY, holding COUNT elements of ELEMENT_SIZE bytes, has room for
+ * one more, growing it and *ALLOCATED if it's full.  The array is allocated
+ * from ARENA, or is P's scratch memory if ARENA is NULL.  Returns the array,
+ * which may have moved, or NULL if there's no memory left, in which case
+ * parsing is stopped and ARRAY is left as it was.
+ */
+void *array_grow(
+    Parser *restrict p, struct Arena *restrict arena,
+    void *array, size_t count, size_t *allocated, size_t element_size)
+{
+    if (count < *allocated)
+        return array;
+    size_t const old_size = *allocated * element_size;
+    size_t const new_allocated = *allocated? 2 * *allocated : 16;
+    void *const grown = (
+        arena != NULL
+        ? arena_realloc(
+            arena, array, old_size, new_allocated * element_size)
+        : mem_realloc(
+            p->allocator, array, old_size, new_allocated * element_size,
+            GIF_AllocCategory_Scratch));
+    if (grown == NULL)
     {
-        LinkedList *next = node->next;
-        free(node->data);
-        free(node);
-        node = next;
+        parser_out_of_memory(p);
+        return NULL;
     }
-    if (node != NULL)
-        parser_error(p, "Unused Graphic Extensions!");
+    *allocated = new_allocated;
+    return grown;
 }
 
-/** Read a byte from P's stream and return it. */
+/**
+ * Read N bytes from P's data into OUT.  If the data runs out first, the rest
+ * of OUT is zeroed, and parsing is stopped.
+ */
+void parser_read(Parser *restrict p, void *restrict out, size_t n)
+{
+    size_t const available = p->size - p->pos;
+    if (n > available)
+    {
+        parser_truncated(p);
+        memset((uint8_t *)out + available, 0, n - available);
+        n = available;
+    }
+    memcpy(out, p->data + p->pos, n);
+    p->pos += n;
+}
+
+/** Read a byte from P's data and return it. */
 uint8_t parser_next(Parser *p)
 {
     uint8_t byte;
-    efread(&byte, 1, 1, p->stream);
+    parser_read(p, &byte, 1);
     return byte;
 }
 
-/** Read a byte from P's stream, unget it, then return it. */
+/** Return the next byte of P's data, without moving past it. */
 uint8_t parser_peek(Parser *p)
 {
-    uint8_t byte = parser_next(p);
-    ungetc(byte, p->stream);
+    uint8_t const byte = parser_next(p);
+    if (p->pos != 0)
+        --p->pos;
     return byte;
 }
 
-/** Read N bytes from P's stream into OUT. */
-void parser_read(Parser *restrict p, void *restrict out, size_t n)
+/**
+ * Queue the image of P's graphic number GRAPHIC to be decoded later.  Its data
+ * is the SIZE bytes starting at DATA.  Returns false if there's no memory
+ * left.
+ */
+bool parser_push_job(
+    Parser *restrict p, size_t graphic,
+    uint8_t const *restrict data, size_t size)
 {
-    efread(out, 1, n, p->stream);
+    struct DecodeJob *const jobs = array_grow(
+        p, NULL, p->jobs, p->job_count, &p->jobs_allocated, sizeof(*p->jobs));
+    if (jobs == NULL)
+        return false;
+    p->jobs = jobs;
+    p->jobs[p->job_count++] = (struct DecodeJob){
+        .graphic = graphic, .data = data, .size = size};
+    return true;
+}
+
+/**
+ * Add a new graphic to the end of P's result, and return it.  The pointer is
+ * only valid until the next graphic is added.  Returns NULL if there's no
+ * memory left.
+ */
+struct GIF_Graphic *parser_add_graphic(Parser *p)
+{
+    GIF *const gif = &p->result;
+    struct GIF_Graphic *const graphics = array_grow(
+        p, &gif->memory->metadata,
+        gif->graphics, gif->graphic_count, &p->graphics_allocated,
+        sizeof(*gif->graphics));
+    if (graphics == NULL)
+        return NULL;
+    gif->graphics = graphics;
+    struct GIF_Graphic *const graphic = &gif->graphics[gif->graphic_count++];
+    memset(graphic, 0, sizeof(*graphic));
+    return graphic;
 }
 
 /** Push a Graphic Control Extension onto P's GCE stack. */
 void parser_push_gext(Parser *restrict p, struct GIF_GraphicExt *restrict gext)
 {
-    linkedlist_append(&p->gext_stack, linkedlist_new(gext));
+    struct GIF_GraphicExt **const stack = array_grow(
+        p, NULL, p->gext_stack, p->gext_count, &p->gexts_allocated,
+        sizeof(*p->gext_stack));
+    if (stack == NULL)
+        return;
+    p->gext_stack = stack;
+    p->gext_stack[p->gext_count++] = gext;
 }
 
 /**
@@ -169,49 +370,88 @@ void parser_push_gext(Parser *restrict p, struct GIF_GraphicExt *restrict gext)
  */
 struct GIF_GraphicExt *parser_pop_gext(Parser *p)
 {
-    if (p->gext_stack == NULL)
+    if (p->gext_count == 0)
         return NULL;
-    if (p->gext_stack->next == NULL)
-    {
-        struct GIF_GraphicExt *gext = p->gext_stack->data;
-        free(p->gext_stack);
-        p->gext_stack = NULL;
-        return gext;
-    }
-
-    LinkedList *node = p->gext_stack;
-    while (node->next->next)
-        node = node->next;
-
-    struct GIF_GraphicExt *gext = node->next->data;
-    free(node->next);
-    node->next = NULL;
-    return gext;
+    return p->gext_stack[--p->gext_count];
 }
 
 
 /* ===[ Add extensions to the GIF ]=== */
+/**
+ * Returns true if EXT has as much data as extension_min_size says it needs.
+ * Shorter extensions are skipped with a warning.
+ */
+bool extension_has_min_size(
+    Parser const *restrict p, struct GenericExtension const *restrict ext)
+{
+    if (ext->data_size >= extension_min_size(ext->label))
+        return true;
+    load_log(
+        &p->options, GIF_LogLevel_Warning,
+        "%s -- extension 0x%.2hhx too short (%zu bytes), skipped",
+        p->state.name, ext->label, ext->data_size);
+    return false;
+}
+
 void add_application_extension(Parser *p, struct GenericExtension ext)
 {
-    struct GIF_ApplicationExt *appext = malloc(sizeof(*appext));
+    if (!extension_has_min_size(p, &ext))
+        return;
+    GIF *const gif = &p->result;
+    uint8_t *const data = arena_alloc(
+        &gif->memory->extensions, ext.data_size - 11);
+    if (data == NULL)
+    {
+        parser_out_of_memory(p);
+        return;
+    }
+    struct GIF_ApplicationExt *const appexts = array_grow(
+        p, &gif->memory->metadata,
+        gif->app_extensions, gif->app_extension_count,
+        &p->app_extensions_allocated, sizeof(*gif->app_extensions));
+    if (appexts == NULL)
+        return;
+    gif->app_extensions = appexts;
+    struct GIF_ApplicationExt *const appext = (
+        &gif->app_extensions[gif->app_extension_count++]);
     memcpy(appext->appid, ext.data, 8);
     memcpy(appext->auth_code, ext.data + 8, 3);
     appext->data_size = ext.data_size - 11;
-    appext->data = malloc(appext->data_size);
+    appext->data = data;
     memcpy(appext->data, ext.data + 11, appext->data_size);
-    linkedlist_append(&p->result.app_extensions, linkedlist_new(appext));
 }
 
 void add_comment_extension(Parser *p, struct GenericExtension ext)
 {
-    char *comment = calloc(ext.data_size + 1, 1);
-    memcpy(comment, ext.data, ext.data_size);
-    linkedlist_append(&p->result.comments, linkedlist_new(comment));
+    GIF *const gif = &p->result;
+    char *comment = arena_strndup(
+        &gif->memory->extensions, ext.data, ext.data_size);
+    if (comment == NULL)
+    {
+        parser_out_of_memory(p);
+        return;
+    }
+    char **const comments = array_grow(
+        p, &gif->memory->metadata,
+        gif->comments, gif->comment_count, &p->comments_allocated,
+        sizeof(*gif->comments));
+    if (comments == NULL)
+        return;
+    gif->comments = comments;
+    gif->comments[gif->comment_count++] = comment;
 }
 
 void add_graphic_control_extension(Parser *p, struct GenericExtension ext)
 {
-    struct GIF_GraphicExt *gext = malloc(sizeof(*gext));
+    if (!extension_has_min_size(p, &ext))
+        return;
+    struct GIF_GraphicExt *gext = arena_alloc(
+        &p->result.memory->extensions, sizeof(*gext));
+    if (gext == NULL)
+    {
+        parser_out_of_memory(p);
+        return;
+    }
     uint8_t fields;
     memcpy(&fields, ext.data+0, 1);
     memcpy(&gext->delay_time, ext.data+1, 2);
@@ -224,6 +464,8 @@ void add_graphic_control_extension(Parser *p, struct GenericExtension ext)
 
 void add_plain_text_extension(Parser *p, struct GenericExtension ext)
 {
+    if (!extension_has_min_size(p, &ext))
+        return;
     struct GIF_PlainTextExt ptext;
     memcpy(&ptext.tg_left    , ext.data+ 0, 2);
     memcpy(&ptext.tg_top     , ext.data+ 2, 2);
@@ -234,13 +476,20 @@ void add_plain_text_extension(Parser *p, struct GenericExtension ext)
     memcpy(&ptext.fg_idx     , ext.data+10, 1);
     memcpy(&ptext.bg_idx     , ext.data+11, 1);
     ptext.data_size = ext.data_size - 12;
-    ptext.data = malloc(ptext.data_size);
+    ptext.data = arena_alloc(
+        &p->result.memory->extensions, ptext.data_size);
+    if (ptext.data == NULL)
+    {
+        parser_out_of_memory(p);
+        return;
+    }
     memcpy(ptext.data, ext.data + 12, ptext.data_size);
-    struct GIF_Graphic *graphic = malloc(sizeof(*graphic));
+    struct GIF_Graphic *graphic = parser_add_graphic(p);
+    if (graphic == NULL)
+        return;
     graphic->extension = parser_pop_gext(p);
     graphic->is_img = false;
     graphic->plaintext = ptext;
-    linkedlist_append(&p->result.graphics, linkedlist_new(graphic));
 }
 
 void add_extension(Parser *p, struct GenericExtension ext)
@@ -260,98 +509,406 @@ void add_extension(Parser *p, struct GenericExtension ext)
         add_plain_text_extension(p, ext);
         break;
     default:
-        parser_error(p, "Invalid extension label 0x%.2hhx", ext.label);
+        parser_error(p, "invalid extension label 0x%.2hhx", ext.label);
         break;
     }
-    free(ext.data);
+    mem_free(p->allocator, ext.data, ext.data_size, GIF_AllocCategory_Scratch);
 }
 
 
 /**
- * Read data sub-blocks from FILE, store these in DATA, and stop when a block
- * terminator is reached.  DATA_SIZE will be filled with the number of bytes
- * read.  Memory pointed to by data must be freed.
+ * Skip past the data sub-blocks at P's position, up to and including the
+ * block terminator.  The blocks are left where they are, for the caller to
+ * find again with next_data_sub_block.  Returns the number of data bytes in
+ * the blocks.
  */
-void read_data_sub_blocks(FILE *file, size_t *data_size, uint8_t **data)
+size_t parser_skip_data_sub_blocks(Parser *p)
 {
-    *data_size = 0;
-    *data = NULL;
+    size_t total = 0;
     for(;;)
     {
-        uint8_t block_size = 0;
+        if (p->pos >= p->size)
+        {
+            parser_truncated(p);
+            return total;
+        }
+        size_t const block_size = next_data_sub_block(
+            p->data, p->size, &p->pos);
+        if (block_size == 0)
+            return total;
+        p->pos += block_size;
+        total += block_size;
+    }
+}
 
-        /* Get the number of bytes in the next block. */
-        efread(&block_size, 1, 1, file);
+/**
+ * Copy the data sub-blocks starting at POS in the SIZE bytes of DATA into one
+ * buffer of scratch memory from ALLOCATOR, and return it.  GATHERED_SIZE will
+ * be filled with the number of bytes gathered.  Returns NULL if there's no
+ * memory left; if there's nothing to gather, it may also return NULL.
+ */
+uint8_t *gather_data_sub_blocks(
+    struct GIF_Allocator const *restrict allocator,
+    uint8_t const *restrict data, size_t size, size_t pos,
+    size_t *restrict gathered_size)
+{
+    *gathered_size = 0;
+    for (size_t p = pos;;)
+    {
+        size_t const n = next_data_sub_block(data, size, &p);
+        if (n == 0)
+            break;
+        *gathered_size += n;
+        p += n;
+    }
 
-        /* A block_size of 0 means we're done. */
-        if (block_size == 0)
-            return;
+    uint8_t *const out = mem_alloc(
+        allocator, *gathered_size, GIF_AllocCategory_Scratch);
+    if (out == NULL)
+        return NULL;
+
+    for (size_t offset = 0;;)
+    {
+        size_t const n = next_data_sub_block(data, size, &pos);
+        if (n == 0)
+            break;
+        memcpy(out + offset, data + pos, n);
+        offset += n;
+        pos += n;
+    }
+    return out;
+}
 
-        /* Resize the data buffer to fit the block. */
-        errno = 0;
-        *data = realloc(*data, (*data_size) + block_size);
-        if (*data == NULL)
-            fatal("realloc: %s\n", strerror(errno));
+/**
+ * Read the data sub-blocks at P's position into DATA, and stop after the block
+ * terminator.  DATA_SIZE will be filled with the number of bytes read.  DATA is
+ * P's scratch memory, and must be freed.  Returns false if there's no memory
+ * left.
+ */
+bool read_data_sub_blocks(Parser *p, size_t *data_size, uint8_t **data)
+{
+    *data = gather_data_sub_blocks(
+        p->allocator, p->data, p->size, p->pos, data_size);
+    if (*data == NULL && *data_size != 0)
+    {
+        parser_out_of_memory(p);
+        return false;
+    }
+    parser_skip_data_sub_blocks(p);
+    return true;
+}
+
+/** Hash the color table with SIZE colors at COLORS, and its SORTED flag. */
+uint64_t color_table_hash(bool sorted, size_t size, uint8_t const *colors)
+{
+    /* FNV-1a. */
+    uint64_t hash = 0xcbf29ce484222325 ^ (sorted? 1 : 0);
+    for (size_t i = 0; i < 3 * size; ++i)
+    {
+        hash ^= colors[i];
+        hash *= 0x100000001b3;
+    }
+    return (hash ^ size) * 0x100000001b3;
+}
+
+/**
+ * Find the slot in P's color table set for a table with HASH, whose contents
+ * are SORTED, SIZE and COLORS.  Returns the slot holding the matching table,
+ * or the empty slot it would go in.
+ */
+struct GIF_ColorTable **parser_find_color_table(
+    Parser const *restrict p, uint64_t hash,
+    bool sorted, size_t size, uint8_t const *restrict colors)
+{
+    size_t const mask = p->color_table_slots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        struct GIF_ColorTable **const slot = &p->color_tables[i];
+        if (*slot == NULL)
+            return slot;
+        if ((*slot)->sorted == sorted
+            && (*slot)->size == size
+            && memcmp((*slot)->colors, colors, 3 * size) == 0)
+        {
+            return slot;
+        }
+    }
+}
 
-        /* Read the data block. */
-        efread(*data + *data_size, 1, block_size, file);
-        *data_size += block_size;
+/**
+ * Make sure P's color table set has room for one more table, keeping it at
+ * most half full.  Returns false if there's no memory left.
+ */
+bool parser_grow_color_tables(Parser *p)
+{
+    if (2 * (p->color_table_count + 1) <= p->color_table_slots)
+        return true;
+    size_t const old_slots = p->color_table_slots;
+    struct GIF_ColorTable **const old = p->color_tables;
+    size_t const slots = old_slots? 2 * old_slots : 16;
+    struct GIF_ColorTable **const grown = mem_alloc(
+        p->allocator, slots * sizeof(*grown), GIF_AllocCategory_Scratch);
+    if (grown == NULL)
+        return false;
+    memset(grown, 0, slots * sizeof(*grown));
+
+    p->color_tables = grown;
+    p->color_table_slots = slots;
+    for (size_t i = 0; i < old_slots; ++i)
+    {
+        struct GIF_ColorTable *const table = old[i];
+        if (table == NULL)
+            continue;
+        uint64_t const hash = color_table_hash(
+            table->sorted, table->size, table->colors);
+        *parser_find_color_table(
+            p, hash, table->sorted, table->size, table->colors) = table;
     }
+    mem_free(
+        p->allocator, old, old_slots * sizeof(*old),
+        GIF_AllocCategory_Scratch);
+    return true;
 }
 
 /**
- * Read SIZE*3 bytes of Color Table data from FILE, storing it in TABLE.
- * Memory pointed to by TABLE must be freed.
+ * Read SIZE*3 bytes of Color Table data from P, and return the table.  If an
+ * identical table has already been loaded, that one is returned instead.
+ * New tables are allocated from the result's color table arena, along with
+ * their RGBA lookup table.  Returns NULL if there's no memory left.
  */
-struct GIF_ColorTable *read_color_table(FILE *file, bool sorted, size_t size)
+struct GIF_ColorTable *read_color_table(Parser *p, bool sorted, size_t size)
 {
-    struct GIF_ColorTable *out = malloc(sizeof(*out));
+    uint8_t colors[3 * COLOR_TABLE_MAX_SIZE];
+    parser_read(p, colors, 3 * size);
+
+    if (!parser_grow_color_tables(p))
+    {
+        parser_out_of_memory(p);
+        return NULL;
+    }
+    uint64_t const hash = color_table_hash(sorted, size, colors);
+    struct GIF_ColorTable **const slot = parser_find_color_table(
+        p, hash, sorted, size, colors);
+    if (*slot != NULL)
+        return *slot;
+
+    struct Arena *const arena = &p->result.memory->color_tables;
+    struct GIF_ColorTable *out = arena_alloc(arena, sizeof(*out));
+    uint8_t *const out_colors = arena_alloc(arena, 3 * size);
+    uint32_t *const rgba = arena_alloc(
+        arena, COLOR_TABLE_MAX_SIZE * sizeof(*rgba));
+    if (out == NULL || out_colors == NULL || rgba == NULL)
+    {
+        parser_out_of_memory(p);
+        return NULL;
+    }
+    memcpy(out_colors, colors, 3 * size);
     out->sorted = sorted;
     out->size = size;
-    out->colors = malloc(3 * size);
-    efread(out->colors, 3, size, file);
+    out->colors = out_colors;
+    gif_colortable_to_rgba(out, rgba);
+    out->rgba = rgba;
+
+    *slot = out;
+    p->color_table_count++;
     return out;
 }
 
-/** Deinterlace interlaced GIF image data. */
-void deinterlace(struct GIF_Image *image)
+/**
+ * Returns true if IMAGE should be decoded straight to RGBA: it must cover the
+ * whole canvas and have no transparent color, so that it's a complete frame
+ * by itself.
+ */
+bool should_expand_image(
+    Parser const *restrict p,
+    struct GIF_Image const *restrict image,
+    struct GIF_GraphicExt const *restrict gext)
 {
-    uint8_t *interlaced = image->pixels;
-    uint8_t *deinterlaced = malloc(image->size);
+    return (
+        p->options.expand_opaque_images
+        && image->color_table != NULL
+        && !(gext && gext->transparent_color_flag)
+        && image->left == 0 && image->top == 0
+        && image->width == p->result.width
+        && image->height == p->result.height);
+}
 
-    /* Current row index of the interlaced data. */
-    size_t n = 0;
+/**
+ * Choose the format IMAGE will be decoded to, and allocate its pixel buffer,
+ * unless P is loading lazily.  Returns false if there's no memory left.
+ */
+bool image_alloc_pixels(
+    Parser *restrict p,
+    struct GIF_Image *restrict image,
+    struct GIF_GraphicExt const *restrict gext)
+{
+    image->format = GIF_PixelFormat_Index8;
+    size_t bytes_per_pixel = 1;
+    if (should_expand_image(p, image, gext))
+    {
+        image->format = GIF_PixelFormat_RGBA32;
+        bytes_per_pixel = 4;
+    }
 
-    /* Group 1: Every 8th row, starting from row 0. */
-    for (size_t y = 0; y < image->height; ++n, y += 8)
+    /* The image descriptor tells us exactly how much data to expect, so
+     * there's no need to let the decoder output any more than that. */
+    image->size = (size_t)image->width * image->height * bytes_per_pixel;
+    image->pixels = NULL;
+    if (p->options.lazy)
+        return true;
+    image->pixels = arena_alloc(&p->result.memory->pixels, image->size);
+    if (image->pixels == NULL)
+    {
+        image->size = 0;
+        parser_out_of_memory(p);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Decode an image's LZW minimum code size and data sub-blocks, from the SIZE
+ * bytes of DATA, into IMAGE's pixel buffer.  Large images are decoded with up
+ * to THREADS threads, using scratch memory from ALLOCATOR.  Problems with the
+ * data are logged as OPTIONS says.
+ */
+void decode_image_data(
+    uint8_t const *restrict data, size_t size,
+    struct GIF_Image *restrict image,
+    unsigned int threads,
+    struct GIF_Allocator const *restrict allocator,
+    struct GIF_LoadOptions const *restrict options)
+{
+    uint8_t const min_code_size = size? data[0] : 0;
+    size_t pos = 1;
+
+    size_t const pixel_count = (size_t)image->width * image->height;
+
+    struct LZW_Decoder decoder;
+    lzw_init(&decoder, min_code_size, image->pixels, pixel_count);
+    if (image->interlace_flag)
+        lzw_set_interlaced(&decoder, image->width);
+    if (image->format == GIF_PixelFormat_RGBA32)
+        lzw_set_palette(&decoder, image->color_table->rgba);
+
+    size_t written = 0;
+    enum LZW_Status status;
+    /* Big enough to be worth splitting up, which needs all the data in one
+     * piece.  Without the memory for that, it's decoded serially. */
+    size_t gathered_size = 0;
+    uint8_t *const gathered = (
+        threads > 1 && pixel_count >= PARALLEL_DECODE_MIN_PIXELS
+        ? gather_data_sub_blocks(allocator, data, size, pos, &gathered_size)
+        : NULL);
+    if (gathered != NULL)
+    {
+        status = lzw_decode_parallel(
+            &decoder, gathered, gathered_size, threads, allocator, &written);
+        mem_free(
+            allocator, gathered, gathered_size, GIF_AllocCategory_Scratch);
+    }
+    else
     {
-        size_t il_row = n * image->width;
-        size_t di_row = y * image->width;
-        memcpy(deinterlaced + di_row, interlaced + il_row, image->width);
+        /* Feed the decoder each data sub-block straight from the data.  It
+         * carries partial codes over from one block to the next. */
+        for(;;)
+        {
+            size_t const n = next_data_sub_block(data, size, &pos);
+            if (n == 0)
+                break;
+            lzw_feed(&decoder, data + pos, n);
+            pos += n;
+        }
+        status = lzw_finish(&decoder, &written);
     }
-    /* Group 2: Every 8th row, starting from row 4. */
-    for (size_t y = 4; y < image->height; ++n, y += 8)
+    switch (status)
     {
-        size_t il_row = n * image->width;
-        size_t di_row = y * image->width;
-        memcpy(deinterlaced + di_row, interlaced + il_row, image->width);
+    case LZW_OK:
+        break;
+    case LZW_SHORT:
+        load_log(
+            options, GIF_LogLevel_Warning,
+            "image data too short (%zu/%zu pixels)", written, pixel_count);
+        break;
+    case LZW_LONG:
+        load_log(
+            options, GIF_LogLevel_Warning,
+            "image data too long, excess pixels dropped");
+        break;
     }
-    /* Group 3: Every 4th row, starting from row 2. */
-    for (size_t y = 2; y < image->height; ++n, y += 4)
+}
+
+
+/* ===[ Parallel Decoding ]=== */
+/** Decoding thread.  Takes jobs from the DecodePool ARG until none are left. */
+void *decodepool_worker(void *arg)
+{
+    struct DecodePool *pool = arg;
+    for(;;)
     {
-        size_t il_row = n * image->width;
-        size_t di_row = y * image->width;
-        memcpy(deinterlaced + di_row, interlaced + il_row, image->width);
+        pthread_mutex_lock(&pool->lock);
+        size_t const i = pool->next_job++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->job_count)
+            break;
+
+        struct DecodeJob const *const job = &pool->jobs[i];
+        decode_image_data(
+            job->data, job->size, &pool->graphics[job->graphic].img,
+            pool->job_threads, pool->allocator, pool->options);
     }
-    /* Group 4: Every 2nd row, starting from row 1. */
-    for (size_t y = 1; y < image->height; ++n, y += 2)
+    return NULL;
+}
+
+/**
+ * Decode the images queued in P, using up to P's requested number of threads.
+ * The calling thread decodes too.
+ */
+void parser_run_jobs(Parser *p)
+{
+    struct DecodePool pool = {
+        .options = &p->options,
+        .allocator = p->allocator,
+        .graphics = p->result.graphics,
+        .jobs = p->jobs,
+        .job_count = p->job_count,
+        .job_threads = p->options.threads / p->job_count,
+        .next_job = 0,
+    };
+    pthread_mutex_init(&pool.lock, NULL);
+
+    size_t thread_count = p->options.threads - 1;
+    if (thread_count > p->job_count)
+        thread_count = p->job_count;
+    pthread_t *threads = mem_alloc(
+        p->allocator, thread_count * sizeof(*threads),
+        GIF_AllocCategory_Scratch);
+    /* Without the memory to keep track of threads, decode everything on this
+     * one. */
+    if (threads == NULL)
+        thread_count = 0;
+
+    size_t started = 0;
+    for (; started < thread_count; ++started)
     {
-        size_t il_row = n * image->width;
-        size_t di_row = y * image->width;
-        memcpy(deinterlaced + di_row, interlaced + il_row, image->width);
+        int const err = pthread_create(
+            threads + started, NULL, decodepool_worker, &pool);
+        if (err != 0)
+        {
+            load_log(
+                &p->options, GIF_LogLevel_Warning,
+                "couldn't start decoding thread (error %d)", err);
+            break;
+        }
     }
-    free(interlaced);
-    image->pixels = deinterlaced;
+    decodepool_worker(&pool);
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    mem_free(
+        p->allocator, threads, thread_count * sizeof(*threads),
+        GIF_AllocCategory_Scratch);
+    pthread_mutex_destroy(&pool.lock);
 }
 
 
@@ -361,14 +918,15 @@ ParseState state_extension(Parser *p)
     uint8_t first = parser_next(p);
     if (first != GIF_ExtensionIntroducer)
     {
-        parser_error(
+        return parser_error(
             p, "expected Extension Introducer (0x%.2hhx), got 0x%.2hhx",
             GIF_ExtensionIntroducer, first);
     }
 
     struct GenericExtension ext;
     ext.label = parser_next(p);
-    read_data_sub_blocks(p->stream, &ext.data_size, &ext.data);
+    if (!read_data_sub_blocks(p, &ext.data_size, &ext.data))
+        return STATE_FINISHED;
 
     add_extension(p, ext);
 
@@ -376,20 +934,36 @@ ParseState state_extension(Parser *p)
 }
 
 /* TODO: Pseudo-state for now. */
-ParseState _state_image_data(Parser *p, struct GIF_Image *image)
+ParseState _state_image_data(Parser *p, size_t graphic_index)
 {
-    uint8_t min_code_size;
-    parser_read(p, &min_code_size, 1);
-
-    uint8_t *compressed = NULL;
-    size_t compressed_size = 0;
-    read_data_sub_blocks(p->stream, &compressed_size, &compressed);
-
-    image->size = unlzw(min_code_size, compressed, &image->pixels);
-    if (image->interlace_flag)
-        deinterlace(image);
+    struct GIF_Graphic *const graphic = &p->result.graphics[graphic_index];
+    struct GIF_Image *const image = &graphic->img;
+    image->data = NULL;
+    image->data_size = 0;
+    if (!image_alloc_pixels(p, image, graphic->extension))
+        return STATE_FINISHED;
+
+    /* The data is decoded where it lies, so just find where it ends. */
+    uint8_t const *const data = p->data + p->pos;
+    parser_next(p);
+    parser_skip_data_sub_blocks(p);
+    size_t const size = (p->data + p->pos) - data;
+
+    /* Lazy images are decoded by the caller, when they want them. */
+    if (p->options.lazy)
+    {
+        image->data = data;
+        image->data_size = size;
+        return STATE_DATA;
+    }
 
-    free(compressed);
+    /* When decoding in parallel, just note where the data is for later. */
+    if (p->options.threads > 1
+        && parser_push_job(p, graphic_index, data, size))
+    {
+        return STATE_DATA;
+    }
+    decode_image_data(data, size, image, 1, p->allocator, &p->options);
     return STATE_DATA;
 }
 
@@ -398,7 +972,7 @@ ParseState state_image(Parser *p)
     uint8_t separator = parser_next(p);
     if (separator != GIF_ImageSeparator)
     {
-        parser_error(
+        return parser_error(
             p, "expected image separator (0x%.2hhx), got 0x%.2hhx",
             GIF_ImageSeparator, separator);
     }
@@ -419,19 +993,23 @@ ParseState state_image(Parser *p)
 
     image.color_table = NULL;
     if (lct_flag)
-        image.color_table = read_color_table(p->stream, sort_flag, lct_size);
+    {
+        image.color_table = read_color_table(p, sort_flag, lct_size);
+        if (image.color_table == NULL)
+            return STATE_FINISHED;
+    }
     else
         image.color_table = p->result.global_color_table;
 
-    _state_image_data(p, &image);
-
-    struct GIF_Graphic *graphic = malloc(sizeof(*graphic));
+    struct GIF_Graphic *graphic = parser_add_graphic(p);
+    if (graphic == NULL)
+        return STATE_FINISHED;
     graphic->extension = parser_pop_gext(p);
     graphic->is_img = true;
     graphic->img = image;
-    linkedlist_append(&p->result.graphics, linkedlist_new(graphic));
-
-    return STATE_DATA;
+    /* Decoding may be deferred, so it's done by index rather than through
+     * the local copy. */
+    return _state_image_data(p, p->result.graphic_count - 1);
 }
 
 ParseState state_trailer(Parser *p)
@@ -439,7 +1017,7 @@ ParseState state_trailer(Parser *p)
     uint8_t trailer = parser_next(p);
     if (trailer != GIF_Trailer)
     {
-        parser_error(
+        return parser_error(
             p, "expected trailer (0x%.2hhx), got 0x%.2hhx",
             GIF_Trailer, trailer);
     }
@@ -448,6 +1026,8 @@ ParseState state_trailer(Parser *p)
 
 ParseState state_data(Parser *p)
 {
+    if (p->pos >= p->size)
+        return parser_truncated(p);
     uint8_t byte = parser_peek(p);
     switch (byte)
     {
@@ -455,7 +1035,7 @@ ParseState state_data(Parser *p)
     case GIF_ImageSeparator:        return STATE_IMAGE;
     case GIF_Trailer:               return STATE_TRAILER;
     }
-    parser_error(p, "unexpected byte 0x%.2hhx\n", byte);
+    return parser_error(p, "unexpected byte 0x%.2hhx", byte);
 }
 
 ParseState state_logical_screen_descriptor(Parser *p)
@@ -477,7 +1057,9 @@ ParseState state_logical_screen_descriptor(Parser *p)
     if (gct_flag)
     {
         p->result.global_color_table = read_color_table(
-            p->stream, sort_flag, gct_size);
+            p, sort_flag, gct_size);
+        if (p->result.global_color_table == NULL)
+            return STATE_FINISHED;
     }
     return STATE_DATA;
 }
@@ -488,7 +1070,7 @@ ParseState state_header(Parser *p)
     parser_read(p, header, 6);
 
     if (strncmp(header, "GIF", 3) != 0)
-        parser_error(p, "bad signature '%.3s'\n", header);
+        return parser_error(p, "bad signature '%.3s'", header);
 
     p->result.version = GIF_Version_Unknown;
     if (strncmp(header + 3, "87a", 3) == 0)
@@ -496,27 +1078,128 @@ ParseState state_header(Parser *p)
     else if (strncmp(header + 3, "89a", 3) == 0)
         p->result.version = GIF_Version_89a;
     else
-        warn("unknown version '%.3s'\n", header + 3);
+    {
+        load_log(
+            &p->options, GIF_LogLevel_Warning, "unknown version '%.3s'",
+            header + 3);
+    }
 
     return STATE_LSD;
 }
 
 
-GIF gif_from_file(char const *filename)
+enum GIF_Status gif_from_memory(
+    void const *restrict data, size_t size,
+    struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif)
 {
-    errno = 0;
-    FILE *file = fopen(filename, "rb");
-    if (file == NULL)
-        fatal("fopen: %s\n", strerror(errno));
-
-    Parser p = {.stream = file, .state = STATE_HEADER, .gext_stack=NULL};
-    while (p.state.fn)
+    Parser p = {
+        .data = data,
+        .size = size,
+        .pos = 0,
+        .state = STATE_HEADER,
+        .status = GIF_Status_OK,
+        .gext_stack = NULL,
+        .gext_count = 0,
+        .gexts_allocated = 0,
+        .graphics_allocated = 0,
+        .comments_allocated = 0,
+        .app_extensions_allocated = 0,
+        .color_tables = NULL,
+        .color_table_slots = 0,
+        .color_table_count = 0,
+        .jobs = NULL,
+        .job_count = 0,
+        .jobs_allocated = 0,
+    };
+    p.options = (struct GIF_LoadOptions){
+        .expand_opaque_images = false,
+        .threads = 1,
+        .lazy = false,
+        .allocator = NULL,
+        .log = NULL,
+        .log_user = NULL,
+    };
+    if (options)
+        p.options = *options;
+    p.result.memory = gif_memory_new(
+        p.options.allocator? p.options.allocator : &gif_default_allocator);
+    if (p.result.memory == NULL)
+    {
+        *gif = p.result;
+        return GIF_Status_OutOfMemory;
+    }
+    p.allocator = &p.result.memory->allocator;
+    while (p.state.fn && p.status == GIF_Status_OK)
         p.state = p.state.fn(&p);
 
-    errno = 0;
-    if (fclose(file))
-        fatal("fclose: %s\n", strerror(errno));
+    /* The decoding jobs refer to DATA, so it has to stay around until
+     * they're done.  Whatever was queued before a problem stopped parsing
+     * is still decoded. */
+    if (p.job_count != 0)
+        parser_run_jobs(&p);
 
     parser_free(&p);
-    return p.result;
+    *gif = p.result;
+    return p.status;
+}
+
+/**
+ * Load a GIF from FILE, as gif_from_memory does.  When loading lazily, FILE is
+ * handed over to the GIF, which keeps it until it's freed; otherwise it's
+ * closed.
+ */
+enum GIF_Status gif_from_filemap(
+    struct FileMap *restrict file,
+    struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif)
+{
+    enum GIF_Status const status = gif_from_memory(
+        file->data, file->size, options, gif);
+    if (options && options->lazy && gif->memory != NULL)
+    {
+        gif->memory->source = *file;
+        gif->memory->has_source = true;
+    }
+    else
+        filemap_close(file);
+    return status;
+}
+
+enum GIF_Status gif_from_fd(
+    int fd, struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif)
+{
+    memset(gif, 0, sizeof(*gif));
+    struct FileMap file;
+    errno = 0;
+    if (!filemap_from_fd(&file, fd))
+        return GIF_Status_ReadError;
+    return gif_from_filemap(&file, options, gif);
+}
+
+enum GIF_Status gif_from_file(
+    char const *restrict filename,
+    struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif)
+{
+    memset(gif, 0, sizeof(*gif));
+    struct FileMap file;
+    errno = 0;
+    if (!filemap_open(&file, filename))
+        return GIF_Status_ReadError;
+    return gif_from_filemap(&file, options, gif);
+}
+
+void gif_image_decode(
+    struct GIF_Image const *restrict image, uint8_t *restrict out,
+    struct GIF_LoadOptions const *restrict options)
+{
+    struct GIF_LoadOptions const quiet = {.log = NULL};
+    struct GIF_Image target = *image;
+    target.pixels = out;
+    /* One thread at a time never needs any scratch memory. */
+    decode_image_data(
+        image->data, image->data_size, &target, 1, &gif_default_allocator,
+        options? options : &quiet);
 }
@@ -18,81 +18,37 @@
  */
 
 #include "gif.h"
+#include "alloc.h"
 
-#include <stdlib.h>
+#include <string.h>
 
 
-void gif_free_colortable(struct GIF_ColorTable *colortable)
+void gif_colortable_to_rgba(
+    struct GIF_ColorTable const *restrict table, uint32_t out[restrict 256])
 {
-    free(colortable->colors);
-}
-
-void gif_free_image(struct GIF_Image *image, struct GIF_ColorTable *gct)
-{
-    /* color_table can point to the GCT, so we need to check for that to avoid
-     * a double-free. */
-    if (image->color_table != NULL && image->color_table != gct)
+    for (size_t i = 0; i < 256; ++i)
     {
-        gif_free_colortable(image->color_table);
-        free(image->color_table);
+        uint8_t rgba[4] = {0xff, 0xff, 0xff, 0xff};
+        if (i < table->size)
+            memcpy(rgba, table->colors + 3 * i, 3);
+        memcpy(out + i, rgba, 4);
     }
-    free(image->pixels);
-}
-
-void gif_free_plaintextext(struct GIF_PlainTextExt *pte)
-{
-    free(pte->data);
 }
 
-void gif_free_applicationext(struct GIF_ApplicationExt *appext)
+char const *gif_status_message(enum GIF_Status status)
 {
-    free(appext->data);
-}
-
-void gif_free_graphic(struct GIF_Graphic *g, struct GIF_ColorTable *gct)
-{
-    if (g->is_img)
+    switch (status)
     {
-        if (g->extension)
-            free(g->extension);
-        gif_free_image(&g->img, gct);
+    case GIF_Status_OK:             return "success";
+    case GIF_Status_Truncated:      return "unexpected end of data";
+    case GIF_Status_Malformed:      return "malformed data";
+    case GIF_Status_OutOfMemory:    return "out of memory";
+    case GIF_Status_ReadError:      return "read error";
     }
-    else
-        gif_free_plaintextext(&g->plaintext);
+    return "unknown error";
 }
 
-
 void gif_free(GIF gif)
 {
-    if (gif.global_color_table != NULL)
-    {
-        gif_free_colortable(gif.global_color_table);
-        free(gif.global_color_table);
-    }
-
-    for (LinkedList *node = gif.graphics; node != NULL;)
-    {
-        gif_free_graphic(node->data, gif.global_color_table);
-        LinkedList *next = node->next;
-        free(node->data);
-        free(node);
-        node = next;
-    }
-
-    for (LinkedList *node = gif.comments; node != NULL;)
-    {
-        LinkedList *next = node->next;
-        free(node->data);
-        free(node);
-        node = next;
-    }
-
-    for (LinkedList *node = gif.app_extensions; node != NULL;)
-    {
-        gif_free_applicationext(node->data);
-        LinkedList *next = node->next;
-        free(node->data);
-        free(node);
-        node = next;
-    }
+    gif_memory_free(gif.memory);
 }
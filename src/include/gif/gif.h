@@ -20,13 +20,14 @@
 #ifndef GIFVIEW_GIF_H
 #define GIFVIEW_GIF_H
 
-#include "linkedlist/linkedlist.h"
-
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
 
+struct GIF_Memory;
+
+
 /** GIF Versions. */
 enum GIF_Version
 {
@@ -35,7 +36,50 @@ enum GIF_Version
     GIF_Version_89a,
 };
 
-/** GIF Color Table */
+/** Results of loading a GIF. */
+enum GIF_Status
+{
+    /** The whole GIF was loaded. */
+    GIF_Status_OK,
+    /**
+     * The data ended before the trailer.  Everything up to that point was
+     * loaded, including as much of the last image as there was.
+     */
+    GIF_Status_Truncated,
+    /**
+     * The data isn't a GIF, or has an invalid block in it.  Everything before
+     * the block was loaded.
+     */
+    GIF_Status_Malformed,
+    /** The allocator ran out of memory.  Whatever fit was loaded. */
+    GIF_Status_OutOfMemory,
+    /** The data couldn't be read, and errno says why.  Nothing was loaded. */
+    GIF_Status_ReadError,
+};
+
+/** Severity of messages logged while loading. */
+enum GIF_LogLevel
+{
+    /** Something odd about the data, which was worked around. */
+    GIF_LogLevel_Warning,
+    /** The reason loading stopped early. */
+    GIF_LogLevel_Error,
+};
+
+/** Formats of decoded image data. */
+enum GIF_PixelFormat
+{
+    /** 1 byte per pixel, an index into the image's color table. */
+    GIF_PixelFormat_Index8,
+    /** 4 bytes per pixel, stored as R, G, B, A bytes in that order. */
+    GIF_PixelFormat_RGBA32,
+};
+
+/**
+ * GIF Color Table.  Tables are interned as they're loaded: every image whose
+ * color table has the same contents shares the same GIF_ColorTable, so
+ * tables can be compared by pointer.
+ */
 struct GIF_ColorTable
 {
     /** If true, the table has been sorted, to assist decoders with limited
@@ -45,6 +89,11 @@ struct GIF_ColorTable
     size_t size;
     /** Color table RGB triples. */
     uint8_t *colors;
+    /**
+     * The table as 32-bit RGBA pixels for all 256 possible indices, as made
+     * by gif_colortable_to_rgba.  Built once, when the table is loaded.
+     */
+    uint32_t const *rgba;
 };
 
 /** Image Descriptor. */
@@ -63,10 +112,20 @@ struct GIF_Image
      */
     struct GIF_ColorTable *color_table;
 
+    /** Format of PIXELS. */
+    enum GIF_PixelFormat format;
     /** Size of PIXELS in bytes. */
     size_t size;
-    /** Decompressed image data. */
+    /** Decompressed image data, or NULL if the GIF was loaded lazily. */
     uint8_t *pixels;
+
+    /**
+     * If the GIF was loaded lazily, the DATA_SIZE bytes of compressed image
+     * data, from the LZW minimum code size to the block terminator, for
+     * gif_image_decode.  NULL otherwise.
+     */
+    uint8_t const *data;
+    size_t data_size;
 };
 
 /** Graphic extension. */
@@ -157,17 +216,291 @@ typedef struct GIF
     /** Pointer to global color table, or NULL if there isn't one. */
     struct GIF_ColorTable *global_color_table;
 
-    /** A list of GIF_Graphics in the GIF. */
-    LinkedList *graphics;
-    /** A list of comments (char *) in the GIF. */
-    LinkedList *comments;
-    /** A list of GIF_ApplicationExts in the GIF. */
-    LinkedList *app_extensions;
+    /** The GRAPHIC_COUNT GIF_Graphics in the GIF, in order. */
+    struct GIF_Graphic *graphics;
+    size_t graphic_count;
+    /** The COMMENT_COUNT comments in the GIF. */
+    char **comments;
+    size_t comment_count;
+    /** The APP_EXTENSION_COUNT GIF_ApplicationExts in the GIF. */
+    struct GIF_ApplicationExt *app_extensions;
+    size_t app_extension_count;
+
+    /**
+     * Memory everything above is allocated from, and the allocator it came
+     * from.  It's all freed at once by gif_free.
+     */
+    struct GIF_Memory *memory;
 } GIF;
 
 
-/* Load a GIF from a file. */
-GIF gif_from_file(char const *filename);
+/**
+ * Where to find one graphic in a GIF's data, and how it's drawn, as found by
+ * gif_index_scan.  Offsets are from the start of the data.
+ */
+struct GIF_IndexEntry
+{
+    /** Whether the graphic is an image, or a Plain Text Extension. */
+    bool is_img;
+    /**
+     * Offset of the graphic's data: an image's LZW minimum code size byte, or
+     * a Plain Text Extension's first data sub-block.
+     */
+    size_t data_offset;
+    /** Number of bytes from DATA_OFFSET to the end of the block terminator. */
+    size_t data_size;
+
+    /** Position and size of the image, or of the text grid. */
+    uint16_t left, top, width, height;
+    /** Whether the image is interlaced or not. */
+    bool interlace_flag;
+    /**
+     * Offset and number of colors of the image's local color table.  If
+     * COLOR_TABLE_SIZE is 0, the image uses the global color table.
+     */
+    size_t color_table_offset, color_table_size;
+
+    /** Whether the graphic has a Graphic Control Extension. */
+    bool has_extension;
+    /** The graphic's Graphic Control Extension, if HAS_EXTENSION is set. */
+    struct GIF_GraphicExt extension;
+};
+
+/**
+ * Structural index of a GIF: the Logical Screen Descriptor, and where each
+ * graphic is, without any of the image data decoded.
+ */
+struct GIF_Index
+{
+    /** GIF version number. */
+    enum GIF_Version version;
+    /** Image dimensions, as specified in the Logical Screen Descriptor. */
+    uint16_t width, height;
+    /** Index into the global color table of the background color. */
+    uint8_t bg_color_index;
+    /**
+     * Offset and number of colors of the global color table, or 0 colors if
+     * there isn't one.
+     */
+    size_t color_table_offset, color_table_size;
+
+    /** The graphics, in the order they appear. */
+    struct GIF_IndexEntry *entries;
+    size_t count;
+    /**
+     * Offsets of the first data sub-block of each comment extension.  Use
+     * gif_index_comment to read them.
+     */
+    size_t *comment_offsets;
+    size_t comment_count;
+    /** Number of application extensions seen. */
+    size_t app_extension_count;
+    /**
+     * Number of times to play the animation, from a NETSCAPE2.0 application
+     * extension, with 0 meaning forever.  -1 if the GIF doesn't specify one.
+     */
+    int32_t loop_count;
+
+    /**
+     * Whether the scan reached the trailer.  If not, the data ended early or
+     * was malformed, and ENTRIES holds the graphics found before that point.
+     */
+    bool complete;
+};
+
+
+/** Kinds of memory the library allocates, so allocators can tell them apart. */
+enum GIF_AllocCategory
+{
+    /** Decoded image pixels. */
+    GIF_AllocCategory_Pixels,
+    /** Global and local color tables. */
+    GIF_AllocCategory_ColorTables,
+    /** Graphic control, plain text, comment and application extensions. */
+    GIF_AllocCategory_Extensions,
+    /** The arrays of graphics, comments and extensions, and the like. */
+    GIF_AllocCategory_Metadata,
+    /** Temporary buffers only used while loading. */
+    GIF_AllocCategory_Scratch,
+    /** Number of categories. */
+    GIF_AllocCategory_Count,
+};
+
+/**
+ * Memory allocation hooks.  Each is passed USER, and the CATEGORY of memory
+ * being allocated.  REALLOC and FREE are also given the size PTR was
+ * allocated with.  ALLOC and REALLOC return NULL if they fail.  When loading
+ * with more than one thread, the hooks are called from several threads at
+ * once.
+ *
+ * Most of a GIF's memory is allocated in large blocks, which are carved up
+ * by the library itself, so the hooks see few calls for each GIF.
+ */
+struct GIF_Allocator
+{
+    void *(*alloc)(void *user, size_t size, enum GIF_AllocCategory category);
+    void *(*realloc)(
+        void *user, void *ptr, size_t old_size, size_t new_size,
+        enum GIF_AllocCategory category);
+    void (*free)(
+        void *user, void *ptr, size_t size, enum GIF_AllocCategory category);
+    void *user;
+};
+
+/**
+ * The allocator used by default: malloc, except that pixels are mapped
+ * straight from the OS where possible.
+ */
+extern struct GIF_Allocator const gif_default_allocator;
+
+/** Statistics kept by a GIF_CountingAllocator. */
+struct GIF_AllocStats
+{
+    /** Number of allocations made, counting each realloc as one. */
+    size_t allocations;
+    /** Number of allocations freed. */
+    size_t frees;
+    /** Bytes currently allocated, and the most that were at once. */
+    size_t bytes, peak_bytes;
+    /** The same, for each category of memory. */
+    size_t category_bytes[GIF_AllocCategory_Count];
+    size_t category_peak_bytes[GIF_AllocCategory_Count];
+};
+
+/**
+ * An allocator which counts the memory passing through it, on its way to and
+ * from BACKING.  Set it up with gif_counting_allocator_init, then pass
+ * ALLOCATOR when loading.  STATS is updated atomically, and can be read at
+ * any time.  It must not be moved once it's set up.
+ */
+struct GIF_CountingAllocator
+{
+    struct GIF_Allocator allocator;
+    struct GIF_Allocator const *backing;
+    struct GIF_AllocStats stats;
+};
+
+
+/** Options controlling how a GIF is loaded. */
+struct GIF_LoadOptions
+{
+    /**
+     * If true, images which cover the whole canvas and have no transparent
+     * color are decoded straight to GIF_PixelFormat_RGBA32, instead of
+     * GIF_PixelFormat_Index8.
+     */
+    bool expand_opaque_images;
+    /**
+     * Number of threads to decode images with.  With 0 or 1, images are
+     * decoded one by one as they're parsed.  Otherwise the file is parsed
+     * first, then all its images are decoded in parallel.
+     */
+    unsigned int threads;
+    /**
+     * If true, images aren't decoded while loading.  Their PIXELS are left
+     * NULL, and DATA points at their compressed data instead, to be decoded
+     * with gif_image_decode when they're needed.  The GIF keeps the file it
+     * was loaded from mapped until gif_free; with gif_from_memory, the data
+     * must outlive the GIF.  THREADS is ignored.
+     */
+    bool lazy;
+    /**
+     * Where the GIF's memory comes from, or NULL for gif_default_allocator.
+     * The GIF keeps using it until gif_free, so it must outlive the GIF.
+     */
+    struct GIF_Allocator const *allocator;
+    /**
+     * Called with LOG_USER for each problem found in the data, with a
+     * one-line MESSAGE (no trailing newline) which is only valid during the
+     * call.  It may be called from decoding threads, several at once.  If
+     * it's NULL, nothing is logged.
+     */
+    void (*log)(void *user, enum GIF_LogLevel level, char const *message);
+    void *log_user;
+};
+
+
+/*
+ * The gif_from_* functions load a GIF into *GIF, and return how that went.
+ * Whatever the result, *GIF holds everything that could be loaded, and must
+ * be freed with gif_free.  OPTIONS may be NULL to use the defaults.  They use
+ * no global state, so any number of GIFs can be loaded at once by different
+ * threads.
+ */
+
+/** Load a GIF from a file. */
+enum GIF_Status gif_from_file(
+    char const *restrict filename,
+    struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif);
+
+/**
+ * Load a GIF from the rest of the file open as FD, which may be a pipe (eg.
+ * stdin).  FD is left open.
+ */
+enum GIF_Status gif_from_fd(
+    int fd, struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif);
+
+/**
+ * Load a GIF from the SIZE bytes at DATA.  DATA can be freed after loading,
+ * unless OPTIONS->lazy is set, in which case the GIF's images point into it,
+ * so it must stay valid until gif_free.
+ */
+enum GIF_Status gif_from_memory(
+    void const *restrict data, size_t size,
+    struct GIF_LoadOptions const *restrict options,
+    GIF *restrict gif);
+
+/** Return a short description of STATUS. */
+char const *gif_status_message(enum GIF_Status status);
+
+/**
+ * Decode IMAGE, from a GIF loaded lazily, into the IMAGE->size bytes at OUT,
+ * in IMAGE->format.  Problems with the data are logged as OPTIONS says, and
+ * if OPTIONS is NULL, nothing is logged.  Images from the same GIF can be
+ * decoded by several threads at once.
+ */
+void gif_image_decode(
+    struct GIF_Image const *restrict image, uint8_t *restrict out,
+    struct GIF_LoadOptions const *restrict options);
+
+/**
+ * Build an index of the SIZE bytes of GIF data at DATA, without decoding any
+ * images.  Only the block structure is read: data sub-blocks are skipped by
+ * their lengths.  Returns INDEX->complete, which is also false if memory ran
+ * out.  The index must be freed with gif_index_free, even if the scan fails.
+ */
+bool gif_index_scan(
+    void const *restrict data, size_t size, struct GIF_Index *restrict index);
+
+/**
+ * Gather the comment whose sub-blocks start at OFFSET in the SIZE bytes of
+ * DATA into a newly-allocated, NUL-terminated string.  Returns NULL if there's
+ * no memory for it.
+ */
+char *gif_index_comment(void const *data, size_t size, size_t offset);
+
+/** Free memory used by INDEX. */
+void gif_index_free(struct GIF_Index *index);
+
+/**
+ * Convert TABLE to 32-bit RGBA pixels (R, G, B, A bytes in that order), for
+ * every possible index.  Indices past the end of TABLE are opaque white.
+ */
+void gif_colortable_to_rgba(
+    struct GIF_ColorTable const *restrict table, uint32_t out[restrict 256]);
+
+/**
+ * Set up COUNTER to count allocations made through it, passing them on to
+ * BACKING, or gif_default_allocator if BACKING is NULL.
+ */
+void gif_counting_allocator_init(
+    struct GIF_CountingAllocator *restrict counter,
+    struct GIF_Allocator const *restrict backing);
+
+/** Return a printable name for CATEGORY. */
+char const *gif_alloc_category_name(enum GIF_AllocCategory category);
 
 /* Deallocate GIF data. */
 void gif_free(GIF gif);
@@ -18,171 +18,717 @@
  */
 
 #include "lzw.h"
+#include "alloc.h"
+#include "kernels/kernels.h"
 
-#include <stdio.h>
-#include <stdint.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-struct Bitstream
+/**
+ * A piece of LZW data which starts right after a clear code (or at the start
+ * of the data).  BIT is the offset of its first code in the data, and POS is
+ * the offset of its first pixel in the output.
+ */
+struct Segment
 {
-    uint8_t const *stream;
-    size_t byte;
     size_t bit;
+    size_t pos;
 };
 
-struct String
+/**
+ * A run of segments decoded by one thread.  DECODER is set up to write output
+ * pixels from START up to END, reading data from BIT onwards.
+ */
+struct Chunk
 {
-    size_t size;
-    uint8_t *data;
+    struct LZW_Decoder decoder;
+    uint8_t const *in;
+    size_t in_size;
+    size_t bit;
+    size_t start, end;
 };
 
-struct Buffer
+
+/** Load as many whole bytes from STREAM into its accumulator as will fit. */
+void bitstream_refill(struct LZW_Bitstream *stream)
 {
-    size_t size;
-    size_t allocated;
-    uint8_t *data;
-};
+    if (stream->size - stream->byte >= 8)
+    {
+        /* Load a full word.  Only the bytes that fit completely are counted
+         * as consumed; the others get loaded again (to the same bit positions)
+         * on the next refill. */
+        uint64_t word;
+        memcpy(&word, stream->stream + stream->byte, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        stream->bits |= word << stream->count;
+        stream->byte += (63 - stream->count) >> 3;
+        stream->count |= 56;
+    }
+    else
+    {
+        /* Near the end of the buffer, so go byte-by-byte. */
+        while (stream->count <= 56 && stream->byte < stream->size)
+        {
+            stream->bits |= (
+                (uint64_t)stream->stream[stream->byte++] << stream->count);
+            stream->count += 8;
+        }
+    }
+}
 
+/**
+ * Read N bits from STREAM into OUT.  Returns false if STREAM doesn't have N
+ * bits left.
+ */
+bool bitstream_read(size_t n, struct LZW_Bitstream *stream, uint16_t *out)
+{
+    if (stream->count < n)
+    {
+        bitstream_refill(stream);
+        if (stream->count < n)
+            return false;
+    }
+    *out = stream->bits & ((UINT64_C(1) << n) - 1);
+    stream->bits >>= n;
+    stream->count -= n;
+    return true;
+}
 
-/** Read N bits from STREAM. */
-unsigned int bitstream_read(size_t n, struct Bitstream *stream)
+/** Add a new code to TABLE at index NEXT, made of PREFIX followed by SUFFIX. */
+void codetable_add(
+    struct LZW_CodeTable *table, uint16_t next, uint16_t prefix, uint8_t suffix)
 {
-    unsigned int out = 0;
-    size_t bit = 0;
+    table->prefix[next] = prefix;
+    table->suffix[next] = suffix;
+    table->first[next] = table->first[prefix];
+    table->length[next] = table->length[prefix] + 1;
+}
 
-    for (size_t i = 0; i < n; ++i)
+/**
+ * Move OUTPUT on to the next row of an interlaced image.  Interlaced images
+ * store every 8th row starting from row 0, then every 8th row starting from
+ * row 4, then every 4th row starting from row 2, then every 2nd row starting
+ * from row 1.
+ */
+void output_next_row(struct LZW_Output *output)
+{
+    static size_t const start[4] = {0, 4, 2, 1};
+    static size_t const step[4] = {8, 8, 4, 2};
+
+    output->y += step[output->pass];
+    while (output->y >= output->height && output->pass < 3)
+        output->y = start[++output->pass];
+    output->row = output->y * output->width;
+    output->x = 0;
+}
+
+/**
+ * Write the LENGTH byte string for CODE into OUTPUT, ending just before pixel
+ * END.  The string is written backwards, starting from its last byte and
+ * following the prefix chain to the first.
+ */
+void output_put_string(
+    struct LZW_Output *restrict output,
+    size_t end,
+    struct LZW_CodeTable const *restrict table,
+    uint16_t code,
+    size_t length)
+{
+    if (output->palette == NULL)
     {
-        unsigned int b = (stream->stream[stream->byte] >> (stream->bit++)) & 1;
-        if (stream->bit >= 8)
+        uint8_t *p = output->data + end;
+        for (size_t i = 0; i < length; ++i)
         {
-            stream->byte++;
-            stream->bit = 0;
+            *--p = table->suffix[code];
+            code = table->prefix[code];
+        }
+    }
+    else
+    {
+        uint32_t *p = (uint32_t *)output->data + end;
+        for (size_t i = 0; i < length; ++i)
+        {
+            *--p = output->palette[table->suffix[code]];
+            code = table->prefix[code];
         }
-        out |= b << (bit++);
     }
-    return out;
 }
 
-/** Append SUFFIX to the end of PREFIX. */
-struct String concat(struct String prefix, char suffix)
+/** Copy LENGTH indices from DATA into OUTPUT, starting at pixel OFFSET. */
+void output_put_run(
+    struct LZW_Output *restrict output,
+    size_t offset,
+    uint8_t const *restrict data,
+    size_t length)
 {
-    struct String new = {
-        .size = prefix.size + 1,
-        .data = malloc(new.size)
-    };
-    memcpy(new.data, prefix.data, prefix.size);
-    new.data[prefix.size] = suffix;
-    return new;
+    if (output->palette == NULL)
+        memcpy(output->data + offset, data, length);
+    else
+    {
+        kernels->expand(
+            (uint32_t *)output->data + offset, data, length, output->palette);
+    }
 }
 
-/** Append DATA to BUFFER. */
-void append(struct Buffer *buffer, struct String data)
+/** Set LENGTH pixels of OUTPUT to index 0, starting at pixel OFFSET. */
+void output_fill(struct LZW_Output *output, size_t offset, size_t length)
 {
-    /* Number of extra bytes to allocate when the buffer is resized. */
-    static size_t const growth_amount = 1024 * 8;
+    if (output->palette == NULL)
+        memset(output->data + offset, 0, length);
+    else
+    {
+        uint32_t *p = (uint32_t *)output->data + offset;
+        for (size_t i = 0; i < length; ++i)
+            p[i] = output->palette[0];
+    }
+}
 
-    size_t const newsize = buffer->size + data.size;
-    if (newsize >= buffer->allocated)
+/**
+ * Move OUTPUT so that the next pixel written is pixel POS, counting in the
+ * order pixels arrive from the decoder.
+ */
+void output_seek(struct LZW_Output *output, size_t pos)
+{
+    static size_t const start[4] = {0, 4, 2, 1};
+    static size_t const step[4] = {8, 8, 4, 2};
+
+    output->size = pos;
+    if (output->width == 0)
+        return;
+
+    /* Find which pass the row falls in, then where it is in that pass. */
+    size_t n = pos / output->width;
+    output->pass = 0;
+    for (; output->pass < 3; ++output->pass)
     {
-        buffer->allocated = newsize + growth_amount;
-        buffer->data = realloc(buffer->data, buffer->allocated);
+        size_t const start_row = start[output->pass];
+        size_t const rows_in_pass = (
+            output->height > start_row
+            ? (output->height - start_row + step[output->pass] - 1)
+                / step[output->pass]
+            : 0);
+        if (n < rows_in_pass)
+            break;
+        n -= rows_in_pass;
     }
-    memcpy(buffer->data + buffer->size, data.data, data.size);
-    buffer->size += data.size;
+    output->y = start[output->pass] + n * step[output->pass];
+    output->row = output->y * output->width;
+    output->x = pos % output->width;
+}
+
+/** Copy LENGTH indices from DATA into the rows of an interlaced OUTPUT. */
+void output_write_interlaced(
+    struct LZW_Output *restrict output,
+    uint8_t const *restrict data,
+    size_t length)
+{
+    while (length > 0)
+    {
+        size_t n = output->width - output->x;
+        if (n > length)
+            n = length;
+        output_put_run(output, output->row + output->x, data, n);
+        data += n;
+        length -= n;
+        output->x += n;
+        if (output->x == output->width)
+            output_next_row(output);
+    }
+}
+
+/**
+ * Append the string for CODE to OUTPUT.  Returns false if the string didn't
+ * fit, in which case only the part of it that fits is written.
+ */
+bool emit(
+    struct LZW_Output *restrict output,
+    struct LZW_CodeTable const *restrict table,
+    uint16_t code)
+{
+    size_t length = table->length[code];
+    size_t const space = output->capacity - output->size;
+    bool const fits = length <= space;
+    if (!fits)
+    {
+        /* Drop the end of the string which would overrun the buffer. */
+        for (; length > space; --length)
+            code = table->prefix[code];
+    }
+
+    if (output->width == 0)
+    {
+        /* Not interlaced, so the string goes straight on the end. */
+        output_put_string(
+            output, output->size + length, table, code, length);
+    }
+    else if (length < output->width - output->x)
+    {
+        /* Interlaced, but the string fits in the current row. */
+        output_put_string(
+            output, output->row + output->x + length, table, code, length);
+        output->x += length;
+    }
+    else
+    {
+        /* Interlaced, and the string reaches the end of the row, so unpack
+         * it first then copy it into place one row at a time. */
+        uint8_t string[LZW_TABLE_SIZE];
+        uint8_t *p = string + length;
+        for (size_t i = 0; i < length; ++i)
+        {
+            *--p = table->suffix[code];
+            code = table->prefix[code];
+        }
+        output_write_interlaced(output, string, length);
+    }
+    output->size += length;
+    return fits;
 }
 
 
-size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
+void lzw_init(
+    struct LZW_Decoder *restrict decoder,
+    size_t min_code_size,
+    uint8_t *restrict out, size_t out_size)
 {
-    /* GIF has a maximum code size of 12 bits, the maximum code table size is
-     * 2^12 = 4096 codes. */
-    size_t const table_size = 4096;
-    struct String table[table_size];
+    decoder->input = (struct LZW_Bitstream){
+        .stream = NULL, .size = 0, .byte = 0, .bits = 0, .count = 0};
+    decoder->output = (struct LZW_Output){
+        .data = out, .size = 0, .capacity = out_size,
+        .palette = NULL,
+        .width = 0, .height = 0, .row = 0, .x = 0, .y = 0, .pass = 0};
 
+    decoder->min_code_size = min_code_size;
     /* Since GIF LZW has a clear code and end-of-input, the code size starts
      * off 1 larger than the minimum code size. */
-    size_t code_size = min_code_size + 1;
+    decoder->code_size = min_code_size + 1;
+    /* Nonsense code sizes stop decoding below, but mustn't overflow here. */
+    decoder->cc = min_code_size <= 11? 1 << min_code_size : 0;
+    decoder->eoi = decoder->cc + 1;
+    decoder->next = decoder->cc + 2;
+    /* Table is in default state already, so any leading clear codes can be
+     * skipped until we get a proper code. */
+    decoder->previous = LZW_NO_CODE;
+    decoder->overrun = false;
 
-    /* Clear code -- when encountered, the table is cleared. */
-    uint16_t const cc = 1 << min_code_size;
-    /* End of input marker. */
-    uint16_t const eoi = cc + 1;
-    /* Index of next available code in table. */
-    uint16_t next = cc + 2;
+    /* The clear and end-of-information codes need to fit in the table. */
+    decoder->finished = (min_code_size < 1 || min_code_size > 11);
+    if (decoder->finished)
+        return;
 
-    /* Initialize the code table with all values less than 2^min_code_size. */
-    for (uint16_t i = 0; i < cc; ++i)
+    /* Initialize the code table with all values less than 2^min_code_size.
+     * These entries are never overwritten, so clearing the table only needs
+     * to reset NEXT. */
+    for (uint16_t i = 0; i < decoder->cc; ++i)
     {
-        table[i].size = 1;
-        table[i].data = malloc(1);
-        table[i].data[0] = i;
+        decoder->table.prefix[i] = 0;
+        decoder->table.suffix[i] = i;
+        decoder->table.first[i] = i;
+        decoder->table.length[i] = 1;
     }
+}
 
-    struct Bitstream input = {.stream = in, .byte = 0, .bit = 0};
-    struct Buffer output = {.size = 0, .data = NULL};
+void lzw_set_interlaced(struct LZW_Decoder *decoder, size_t width)
+{
+    decoder->output.width = width;
+    decoder->output.height = width? decoder->output.capacity / width : 0;
+}
 
-    uint16_t symbol = 0;
-    /* Table is in default state already, so we can skip any leading clear
-     * codes until we get a proper code. */
-    do
-    {
-        symbol = bitstream_read(code_size, &input);
-        if (symbol == eoi)
-            goto LZW_done;
-    } while (symbol == cc);
-    struct String previous = table[symbol];
-    append(&output, previous);
+void lzw_set_palette(struct LZW_Decoder *decoder, uint32_t const *palette)
+{
+    decoder->output.palette = palette;
+}
+
+/**
+ * The body of lzw_feed.  It's inlined into a copy for each instruction set,
+ * so the bit extraction in the AVX2 copy can use BMI2's variable shifts and
+ * masks.
+ */
+static inline __attribute__((always_inline)) bool lzw_feed_generic(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size)
+{
+    /* Working copies, so the compiler can keep them in registers. */
+    struct LZW_Bitstream input = decoder->input;
+    size_t code_size = decoder->code_size;
+    uint16_t const cc = decoder->cc;
+    uint16_t const eoi = decoder->eoi;
+    uint16_t next = decoder->next;
+    uint16_t previous = decoder->previous;
+    struct LZW_CodeTable *const table = &decoder->table;
+
+    input.stream = in;
+    input.size = in_size;
+    input.byte = 0;
 
-    for(;;)
+    uint16_t symbol;
+    while (bitstream_read(code_size, &input, &symbol))
     {
-        symbol = bitstream_read(code_size, &input);
         if (symbol == cc)
         {
-            for (uint16_t i = cc + 2; i < next; ++i)
-                free(table[i].data);
-            code_size = min_code_size + 1;
+            code_size = decoder->min_code_size + 1;
             next = cc + 2;
-            do
-            {
-                symbol = bitstream_read(code_size, &input);
-                if (symbol == eoi)
-                    goto LZW_done;
-            } while (symbol == cc);
-            previous = table[symbol];
-            append(&output, previous);
+            previous = LZW_NO_CODE;
+            continue;
         }
         else if (symbol == eoi)
         {
-            goto LZW_done;
+            decoder->finished = true;
+            break;
+        }
+        else if (previous == LZW_NO_CODE)
+        {
+            /* First code after a clear must be one of the root codes. */
+            if (symbol > cc)
+            {
+                decoder->finished = true;
+                break;
+            }
+            previous = symbol;
         }
         else if (symbol < next)
         {
-            struct String const W = table[symbol];
-            append(&output, W);
-            if (next < table_size)
-                table[next++] = concat(previous, W.data[0]);
-            previous = W;
+            if (next < LZW_TABLE_SIZE)
+                codetable_add(table, next++, previous, table->first[symbol]);
+            previous = symbol;
         }
         else
         {
-            struct String const V = concat(previous, previous.data[0]);
-            append(&output, V);
-            if (next < table_size)
-                table[next++] = V;
-            previous = V;
+            /* The code isn't in the table yet, so it must be PREVIOUS plus
+             * the first byte of PREVIOUS (the KwKwK case). */
+            if (next >= LZW_TABLE_SIZE)
+            {
+                decoder->finished = true;
+                break;
+            }
+            codetable_add(table, next, previous, table->first[previous]);
+            previous = next++;
         }
+
+        if (!emit(&decoder->output, table, previous))
+        {
+            decoder->overrun = true;
+            decoder->finished = true;
+            break;
+        }
+
         /* Once the code table contains 2^code_size values, the code size must
          * be increased. */
-        if (next == (1 << code_size) && next < table_size)
+        if (next == (1 << code_size) && next < LZW_TABLE_SIZE)
             code_size++;
     }
 
-LZW_done:
-    for (size_t i = 0; i < next; ++i)
-        if (i != cc && i != eoi)
-            free(table[i].data);
-    *out = realloc(output.data, output.size);
-    return output.size;
+    decoder->input = input;
+    decoder->code_size = code_size;
+    decoder->next = next;
+    decoder->previous = previous;
+    return !decoder->finished;
+}
+
+bool lzw_feed_scalar(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size)
+{
+    return lzw_feed_generic(decoder, in, in_size);
+}
+
+#if KERNELS_X86
+KERNELS_TARGET("avx2,bmi,bmi2") bool lzw_feed_avx2(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size)
+{
+    return lzw_feed_generic(decoder, in, in_size);
+}
+#endif
+
+bool lzw_feed(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size)
+{
+    if (decoder->finished)
+        return false;
+#if KERNELS_X86
+    if (kernels->cpu >= Kernels_CPU_AVX2)
+        return lzw_feed_avx2(decoder, in, in_size);
+#endif
+    return lzw_feed_scalar(decoder, in, in_size);
+}
+
+enum LZW_Status lzw_finish(
+    struct LZW_Decoder *restrict decoder, size_t *restrict written)
+{
+    struct LZW_Output *const output = &decoder->output;
+    *written = output->size;
+    if (decoder->overrun)
+        return LZW_LONG;
+    if (output->size == output->capacity)
+        return LZW_OK;
+
+    /* Data ended early, so blank out the rest of the image. */
+    if (output->width == 0)
+        output_fill(output, output->size, output->capacity - output->size);
+    else
+    {
+        while (output->size < output->capacity)
+        {
+            size_t const n = output->width - output->x;
+            output_fill(output, output->row + output->x, n);
+            output->size += n;
+            output_next_row(output);
+        }
+    }
+    return LZW_SHORT;
+}
+
+/**
+ * Scan through IN without decoding it, to find where each segment of the data
+ * starts and where its output will go.  The output of DECODER's image is
+ * tracked only by length, using a table of string lengths in place of the
+ * code table.  The segments are returned in SEGMENTS, an array of *ALLOCATED
+ * elements of scratch memory from ALLOCATOR, and the number of segments is
+ * returned.  If memory runs out, the segments found so far are returned, and
+ * if there's none at all for SEGMENTS, 0 is returned.
+ */
+size_t lzw_scan_segments(
+    struct LZW_Decoder const *restrict decoder,
+    uint8_t const *restrict in, size_t in_size,
+    struct GIF_Allocator const *restrict allocator,
+    struct Segment **restrict segments, size_t *restrict allocated)
+{
+    size_t count = 0;
+    *allocated = 16;
+    *segments = mem_alloc(
+        allocator, *allocated * sizeof(**segments),
+        GIF_AllocCategory_Scratch);
+    if (*segments == NULL)
+    {
+        *allocated = 0;
+        return 0;
+    }
+    (*segments)[count++] = (struct Segment){.bit = 0, .pos = 0};
+
+    uint16_t length[LZW_TABLE_SIZE];
+    for (size_t i = 0; i < decoder->cc; ++i)
+        length[i] = 1;
+
+    struct LZW_Bitstream input = {
+        .stream = in, .size = in_size, .byte = 0, .bits = 0, .count = 0};
+    size_t code_size = decoder->code_size;
+    uint16_t const cc = decoder->cc;
+    uint16_t const eoi = decoder->eoi;
+    uint16_t next = decoder->next;
+    uint16_t previous = LZW_NO_CODE;
+    size_t pos = 0;
+    size_t const capacity = decoder->output.capacity;
+
+    uint16_t symbol;
+    while (!decoder->finished && bitstream_read(code_size, &input, &symbol))
+    {
+        if (symbol == cc)
+        {
+            code_size = decoder->min_code_size + 1;
+            next = cc + 2;
+            previous = LZW_NO_CODE;
+
+            /* Back-to-back clears just move the segment's start forward. */
+            struct Segment const segment = {
+                .bit = input.byte * 8 - input.count, .pos = pos};
+            if ((*segments)[count - 1].pos == pos)
+                (*segments)[count - 1] = segment;
+            else
+            {
+                if (count == *allocated)
+                {
+                    struct Segment *const grown = mem_realloc(
+                        allocator, *segments,
+                        count * sizeof(**segments),
+                        2 * count * sizeof(**segments),
+                        GIF_AllocCategory_Scratch);
+                    /* Fewer segments just means bigger chunks. */
+                    if (grown == NULL)
+                        break;
+                    *segments = grown;
+                    *allocated = 2 * count;
+                }
+                (*segments)[count++] = segment;
+            }
+            continue;
+        }
+        else if (symbol == eoi)
+            break;
+        else if (previous == LZW_NO_CODE)
+        {
+            if (symbol > cc)
+                break;
+            previous = symbol;
+        }
+        else if (symbol < next)
+        {
+            if (next < LZW_TABLE_SIZE)
+                length[next++] = length[previous] + 1;
+            previous = symbol;
+        }
+        else
+        {
+            if (next >= LZW_TABLE_SIZE)
+                break;
+            length[next] = length[previous] + 1;
+            previous = next++;
+        }
+
+        pos += length[previous];
+        if (pos >= capacity)
+            break;
+
+        if (next == (1 << code_size) && next < LZW_TABLE_SIZE)
+            code_size++;
+    }
+    return count;
+}
+
+/** Decoding thread.  Decodes the Chunk ARG. */
+void *chunk_worker(void *arg)
+{
+    struct Chunk *chunk = arg;
+    struct LZW_Bitstream *const input = &chunk->decoder.input;
+
+    /* Preload what's left of the byte the chunk's first code starts in, so
+     * lzw_feed can carry on from the next whole byte. */
+    size_t byte = chunk->bit / 8;
+    if (chunk->bit % 8 != 0)
+    {
+        input->bits = chunk->in[byte++] >> (chunk->bit % 8);
+        input->count = 8 - chunk->bit % 8;
+    }
+    lzw_feed(&chunk->decoder, chunk->in + byte, chunk->in_size - byte);
+    return NULL;
+}
+
+enum LZW_Status lzw_decode_parallel(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size,
+    unsigned int threads,
+    struct GIF_Allocator const *restrict allocator,
+    size_t *restrict written)
+{
+    struct Segment *segments = NULL;
+    size_t segments_allocated = 0;
+    size_t const segment_count = (
+        threads > 1
+        ? lzw_scan_segments(
+            decoder, in, in_size, allocator, &segments, &segments_allocated)
+        : 1);
+    size_t const segments_size = segments_allocated * sizeof(*segments);
+    if (segment_count < 2)
+    {
+        mem_free(
+            allocator, segments, segments_size, GIF_AllocCategory_Scratch);
+        lzw_feed(decoder, in, in_size);
+        return lzw_finish(decoder, written);
+    }
+
+    /* Share the segments out so each thread gets about the same amount of
+     * output to produce.  The scan ends where decoding would stop, so the
+     * total output size is only known to be at least the last segment's
+     * start; the last chunk simply runs to the end of the data. */
+    if (threads > segment_count)
+        threads = segment_count;
+    size_t const total = segments[segment_count - 1].pos;
+    struct Chunk *chunks = mem_alloc(
+        allocator, threads * sizeof(*chunks), GIF_AllocCategory_Scratch);
+    if (chunks == NULL)
+    {
+        mem_free(
+            allocator, segments, segments_size, GIF_AllocCategory_Scratch);
+        lzw_feed(decoder, in, in_size);
+        return lzw_finish(decoder, written);
+    }
+    size_t chunk_count = 0;
+    for (size_t i = 0; i < segment_count && chunk_count < threads;)
+    {
+        size_t const target = (total * (chunk_count + 1)) / threads;
+        size_t j = i + 1;
+        while (j < segment_count && segments[j].pos < target)
+            ++j;
+        if (chunk_count == threads - 1)
+            j = segment_count;
+
+        struct Chunk *const chunk = &chunks[chunk_count++];
+        chunk->in = in;
+        chunk->in_size = in_size;
+        chunk->bit = segments[i].bit;
+        chunk->start = segments[i].pos;
+        chunk->end = (
+            j < segment_count
+            ? segments[j].pos
+            : decoder->output.capacity);
+        i = j;
+    }
+    mem_free(allocator, segments, segments_size, GIF_AllocCategory_Scratch);
+
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        struct Chunk *const chunk = &chunks[i];
+        chunk->decoder = *decoder;
+        chunk->decoder.output.capacity = chunk->end;
+        output_seek(&chunk->decoder.output, chunk->start);
+    }
+
+    /* The calling thread takes the first chunk. */
+    pthread_t *workers = mem_alloc(
+        allocator, chunk_count * sizeof(*workers), GIF_AllocCategory_Scratch);
+    bool *started = mem_alloc(
+        allocator, chunk_count * sizeof(*started), GIF_AllocCategory_Scratch);
+    /* Without the memory to keep track of threads, decode every chunk on this
+     * one. */
+    bool const spawn = workers != NULL && started != NULL;
+    for (size_t i = 1; spawn && i < chunk_count; ++i)
+    {
+        started[i] = (
+            pthread_create(workers + i, NULL, chunk_worker, &chunks[i]) == 0);
+    }
+    chunk_worker(&chunks[0]);
+    for (size_t i = 1; i < chunk_count; ++i)
+    {
+        if (spawn && started[i])
+            pthread_join(workers[i], NULL);
+        else
+            chunk_worker(&chunks[i]);
+    }
+
+    /* Only the last chunk's result matters; the others stop exactly where
+     * the next one starts. */
+    struct LZW_Decoder *const last = &chunks[chunk_count - 1].decoder;
+    last->output.capacity = decoder->output.capacity;
+    enum LZW_Status const status = lzw_finish(last, written);
+    decoder->finished = true;
+    decoder->overrun = last->overrun;
+    decoder->output = last->output;
+
+    mem_free(
+        allocator, started, chunk_count * sizeof(*started),
+        GIF_AllocCategory_Scratch);
+    mem_free(
+        allocator, workers, chunk_count * sizeof(*workers),
+        GIF_AllocCategory_Scratch);
+    mem_free(
+        allocator, chunks, threads * sizeof(*chunks),
+        GIF_AllocCategory_Scratch);
+    return status;
+}
+
+enum LZW_Status unlzw(
+    size_t min_code_size,
+    uint8_t const *restrict in, size_t in_size,
+    uint8_t *restrict out, size_t out_size,
+    size_t *restrict written)
+{
+    struct LZW_Decoder decoder;
+    lzw_init(&decoder, min_code_size, out, out_size);
+    lzw_feed(&decoder, in, in_size);
+    return lzw_finish(&decoder, written);
 }
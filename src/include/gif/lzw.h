@@ -20,15 +20,183 @@
 #ifndef GIFVIEW_LZW_H
 #define GIFVIEW_LZW_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
 
+struct GIF_Allocator;
+
+
+/* GIF has a maximum code size of 12 bits, so the maximum code table size is
+ * 2^12 = 4096 codes. */
+#define LZW_TABLE_SIZE 4096
+
+/** Placeholder for "no code", used where a code is optional. */
+#define LZW_NO_CODE 0xFFFF
+
+
+/** Outcome of decompressing LZW data into a fixed-size buffer. */
+enum LZW_Status
+{
+    /** The data exactly filled the output buffer. */
+    LZW_OK,
+    /** The data ended before the output buffer was filled. */
+    LZW_SHORT,
+    /** The data didn't fit in the output buffer.  The excess was dropped. */
+    LZW_LONG,
+};
+
+/**
+ * LSB-first bit reader.  BITS holds COUNT unread bits, refilled from STREAM a
+ * 64-bit word at a time.  BYTE is the index of the next byte of STREAM to load
+ * into BITS.  Unread bits are kept in BITS when STREAM is swapped out for the
+ * next chunk of input.
+ */
+struct LZW_Bitstream
+{
+    uint8_t const *stream;
+    size_t size;
+    size_t byte;
+    uint64_t bits;
+    unsigned int count;
+};
+
+/**
+ * LZW code table.  Each code is stored as its PREFIX code plus a SUFFIX byte,
+ * so adding a code never needs to copy a string.  LENGTH and FIRST cache the
+ * length and first byte of each code's string.
+ */
+struct LZW_CodeTable
+{
+    uint16_t prefix[LZW_TABLE_SIZE];
+    uint8_t suffix[LZW_TABLE_SIZE];
+    uint8_t first[LZW_TABLE_SIZE];
+    uint16_t length[LZW_TABLE_SIZE];
+};
+
+/**
+ * Fixed-size output buffer.  SIZE pixels out of CAPACITY have been written.
+ *
+ * If PALETTE is NULL, each pixel is stored as a 1 byte color index.  Otherwise
+ * each pixel is stored as the 4 byte value PALETTE gives for its index.
+ *
+ * If WIDTH is nonzero, the buffer holds a WIDTH by HEIGHT image whose rows
+ * arrive in GIF interlaced order, and each row is written directly to its
+ * final position.  ROW is the offset of the row currently being written, X is
+ * the position within it, and Y and PASS track the interlace schedule.
+ */
+struct LZW_Output
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+
+    uint32_t const *palette;
+
+    size_t width, height;
+    size_t row, x, y;
+    unsigned int pass;
+};
+
+/**
+ * Resumable LZW decoder.  Compressed data can be fed to the decoder in chunks
+ * of any size (eg. one GIF data sub-block at a time); the code table and any
+ * partially read code are carried over from one chunk to the next.
+ */
+struct LZW_Decoder
+{
+    struct LZW_CodeTable table;
+    struct LZW_Bitstream input;
+    struct LZW_Output output;
+
+    size_t min_code_size;
+    /** Current code size in bits. */
+    size_t code_size;
+    /** Clear code and end-of-information code. */
+    uint16_t cc, eoi;
+    /** Index of next available code in table. */
+    uint16_t next;
+    /** Previously decoded code, or LZW_NO_CODE right after a clear. */
+    uint16_t previous;
+    /** Set once decoding has stopped, either normally or due to an error. */
+    bool finished;
+    /** Set if the output buffer overflowed. */
+    bool overrun;
+};
+
+
+/**
+ * Prepare DECODER to decompress data with the given MIN_CODE_SIZE into the
+ * OUT_SIZE pixel buffer OUT.
+ */
+void lzw_init(
+    struct LZW_Decoder *restrict decoder,
+    size_t min_code_size,
+    uint8_t *restrict out, size_t out_size);
+
+/**
+ * Have DECODER write its output as an interlaced image, WIDTH pixels wide.  The
+ * image's rows will be stored in their proper (deinterlaced) order.  Must be
+ * called after lzw_init and before any data is fed to the decoder.
+ */
+void lzw_set_interlaced(struct LZW_Decoder *decoder, size_t width);
+
+/**
+ * Have DECODER look up each decoded index in the 256 entry table PALETTE and
+ * store the 4 byte result, instead of storing the index itself.  The output
+ * buffer must be 4-byte aligned and its size is counted in pixels.  Must be
+ * called after lzw_init and before any data is fed to the decoder.
+ */
+void lzw_set_palette(struct LZW_Decoder *decoder, uint32_t const *palette);
+
+/**
+ * Decompress the next IN_SIZE bytes of LZW-compressed data.  Returns false once
+ * decoding has stopped, meaning any further data will be ignored.  Decoding
+ * stops at the end-of-information code or when the output buffer is full.
+ */
+bool lzw_feed(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size);
+
+/**
+ * Finish decoding.  The number of pixels decoded into the output buffer is
+ * returned in WRITTEN.  Any part of the buffer that wasn't decoded into is set
+ * to index 0.
+ */
+enum LZW_Status lzw_finish(
+    struct LZW_Decoder *restrict decoder, size_t *restrict written);
+
+/**
+ * Decompress all IN_SIZE bytes of LZW-compressed data with DECODER, which must
+ * be freshly initialized, then finish decoding as lzw_finish does.
+ *
+ * Every clear code resets the code table, so the data between two clear codes
+ * can be decoded independently of the rest.  The data is scanned once to find
+ * where each of these segments starts and where its output goes, then the
+ * segments are shared out between up to THREADS threads.  If the data has no
+ * clear codes (or THREADS is 1), it's decoded serially.  The bookkeeping for
+ * this is scratch memory from ALLOCATOR; if that runs out, the data is decoded
+ * serially too.
+ */
+enum LZW_Status lzw_decode_parallel(
+    struct LZW_Decoder *restrict decoder,
+    uint8_t const *restrict in, size_t in_size,
+    unsigned int threads,
+    struct GIF_Allocator const *restrict allocator,
+    size_t *restrict written);
+
 /**
- * Decompress LZW-compressed data from IN into OUT.  Returns the number of
- * bytes stored in OUT.
+ * Decompress IN_SIZE bytes of LZW-compressed data from IN into the OUT_SIZE
+ * byte buffer OUT.  The number of bytes decoded into OUT is returned in
+ * WRITTEN; the rest of OUT is zeroed.  Decoding stops at the end-of-information
+ * code, when IN runs out, or when OUT is full, whichever comes first.
  */
-size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out);
+enum LZW_Status unlzw(
+    size_t min_code_size,
+    uint8_t const *restrict in, size_t in_size,
+    uint8_t *restrict out, size_t out_size,
+    size_t *restrict written);
 
 
 #endif /* GIFVIEW_LZW_H */
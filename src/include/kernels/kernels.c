@@ -0,0 +1,459 @@
+/*
+ * kernels.c -- CPU-specific pixel kernels.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "kernels.h"
+
+#include <string.h>
+
+#if KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+/*
+ * Each kernel is written once, as an always-inlined generic version, and then
+ * instantiated for every instruction set so the compiler can vectorize it to
+ * suit.  The scalar instantiations have vectorization turned off, so
+ * --cpu=scalar really is scalar.
+ */
+#define KERNELS_GENERIC  static inline __attribute__((always_inline))
+#if defined(__GNUC__) && !defined(__clang__)
+#define KERNELS_SCALAR  __attribute__((optimize("no-tree-vectorize")))
+#else
+#define KERNELS_SCALAR
+#endif
+
+
+/* ===[ Generic Kernels ]=== */
+KERNELS_GENERIC void expand_generic(
+    uint32_t *restrict out,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette)
+{
+    for (size_t i = 0; i < n; ++i)
+        out[i] = palette[in[i]];
+}
+
+KERNELS_GENERIC void blit_keyed_generic(
+    uint32_t *restrict out,
+    uint32_t *restrict out2,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette,
+    uint8_t key)
+{
+    if (out2 == NULL)
+    {
+        for (size_t i = 0; i < n; ++i)
+            out[i] = in[i] == key? out[i] : palette[in[i]];
+    }
+    else
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if (in[i] != key)
+            {
+                out[i] = palette[in[i]];
+                out2[i] = out[i];
+            }
+        }
+    }
+}
+
+
+/* ===[ Scalar ]=== */
+KERNELS_SCALAR void expand_scalar(
+    uint32_t *restrict out,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette)
+{
+    expand_generic(out, in, n, palette);
+}
+
+KERNELS_SCALAR void blit_keyed_scalar(
+    uint32_t *restrict out,
+    uint32_t *restrict out2,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette,
+    uint8_t key)
+{
+    blit_keyed_generic(out, out2, in, n, palette, key);
+}
+
+static struct Kernels const kernels_scalar = {
+    .cpu = Kernels_CPU_Scalar,
+    .expand = expand_scalar,
+    .blit_keyed = blit_keyed_scalar,
+};
+
+
+#if KERNELS_X86
+/* ===[ SSE2 ]=== */
+/** Look up the four indices packed into FOUR in PALETTE. */
+KERNELS_GENERIC KERNELS_TARGET("sse2") __m128i lookup4_sse2(
+    uint32_t four, uint32_t const *restrict palette)
+{
+    return _mm_setr_epi32(
+        palette[four & 0xff],
+        palette[(four >> 8) & 0xff],
+        palette[(four >> 16) & 0xff],
+        palette[four >> 24]);
+}
+
+/*
+ * SSE2 has no gathers or byte shuffles, so the lookups are still done one at
+ * a time, but the indices are read and the pixels written 16 at a time.
+ */
+KERNELS_TARGET("sse2") void expand_sse2(
+    uint32_t *restrict out,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i indices = _mm_loadu_si128((__m128i const *)(in + i));
+        for (size_t j = 0; j < 16; j += 4)
+        {
+            __m128i const pixels = lookup4_sse2(
+                _mm_cvtsi128_si32(indices), palette);
+            indices = _mm_srli_si128(indices, 4);
+            _mm_storeu_si128((__m128i *)(out + i + j), pixels);
+        }
+    }
+    expand_generic(out + i, in + i, n - i, palette);
+}
+
+/** Write PIXELS to P where MASK is set, leaving the rest of P as it is. */
+KERNELS_GENERIC KERNELS_TARGET("sse2") void store_masked_sse2(
+    __m128i *p, __m128i pixels, __m128i mask)
+{
+    __m128i const old = _mm_andnot_si128(mask, _mm_loadu_si128(p));
+    _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(mask, pixels), old));
+}
+
+/*
+ * Works on 16 pixels at a time.  Blocks which are all transparent are skipped
+ * and blocks with no transparent pixels are stored directly; only the blocks
+ * in between need to merge with what's already in the output.
+ */
+KERNELS_TARGET("sse2") void blit_keyed_sse2(
+    uint32_t *restrict out,
+    uint32_t *restrict out2,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette,
+    uint8_t key)
+{
+    __m128i const keys = _mm_set1_epi8((char)key);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i indices = _mm_loadu_si128((__m128i const *)(in + i));
+        __m128i const transparent = _mm_cmpeq_epi8(indices, keys);
+        int const transparent_bits = _mm_movemask_epi8(transparent);
+        if (transparent_bits == 0xffff)
+            continue;
+
+        /* Widen the per-byte opacity mask to one per pixel. */
+        __m128i const opaque = _mm_xor_si128(
+            transparent, _mm_set1_epi8((char)0xff));
+        __m128i const opaque16_lo = _mm_unpacklo_epi8(opaque, opaque);
+        __m128i const opaque16_hi = _mm_unpackhi_epi8(opaque, opaque);
+        __m128i const masks[4] = {
+            _mm_unpacklo_epi16(opaque16_lo, opaque16_lo),
+            _mm_unpackhi_epi16(opaque16_lo, opaque16_lo),
+            _mm_unpacklo_epi16(opaque16_hi, opaque16_hi),
+            _mm_unpackhi_epi16(opaque16_hi, opaque16_hi),
+        };
+
+        for (size_t j = 0; j < 4; ++j)
+        {
+            __m128i const pixels = lookup4_sse2(
+                _mm_cvtsi128_si32(indices), palette);
+            indices = _mm_srli_si128(indices, 4);
+            size_t const at = i + 4 * j;
+            if (transparent_bits == 0)
+            {
+                _mm_storeu_si128((__m128i *)(out + at), pixels);
+                if (out2 != NULL)
+                    _mm_storeu_si128((__m128i *)(out2 + at), pixels);
+            }
+            else
+            {
+                store_masked_sse2((__m128i *)(out + at), pixels, masks[j]);
+                if (out2 != NULL)
+                {
+                    store_masked_sse2(
+                        (__m128i *)(out2 + at), pixels, masks[j]);
+                }
+            }
+        }
+    }
+    blit_keyed_generic(
+        out + i, out2? out2 + i : NULL, in + i, n - i, palette, key);
+}
+
+static struct Kernels const kernels_sse2 = {
+    .cpu = Kernels_CPU_SSE2,
+    .expand = expand_sse2,
+    .blit_keyed = blit_keyed_sse2,
+};
+
+
+/* ===[ AVX2 ]=== */
+/**
+ * The first 16 entries of a palette, split into planes of R, G, B and A
+ * bytes, each repeated in both 128-bit lanes for byte shuffles.
+ */
+struct Planes_AVX2
+{
+    __m256i r, g, b, a;
+};
+
+KERNELS_GENERIC KERNELS_TARGET("avx2")
+struct Planes_AVX2 planes_avx2(uint32_t const *palette)
+{
+    uint8_t planes[4][16];
+    uint8_t const *const bytes = (uint8_t const *)palette;
+    for (size_t c = 0; c < 4; ++c)
+        for (size_t j = 0; j < 16; ++j)
+            planes[c][j] = bytes[4 * j + c];
+    return (struct Planes_AVX2){
+        .r = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((__m128i const *)planes[0])),
+        .g = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((__m128i const *)planes[1])),
+        .b = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((__m128i const *)planes[2])),
+        .a = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((__m128i const *)planes[3])),
+    };
+}
+
+/**
+ * Look up the 32 INDICES read from IN, and put the pixels in OUT, 8 per
+ * vector.  When all the indices are below 16, the lookup is done with byte
+ * shuffles, one per color channel, using PLANES.  Otherwise the pixels are
+ * looked up one at a time: gathers are no faster than that on many CPUs.
+ */
+KERNELS_GENERIC KERNELS_TARGET("avx2") void lookup32_avx2(
+    __m256i out[4],
+    __m256i indices,
+    uint8_t const *restrict in,
+    uint32_t const *restrict palette,
+    struct Planes_AVX2 const *planes)
+{
+    if (!_mm256_testz_si256(indices, _mm256_set1_epi8((char)0xf0)))
+    {
+        for (size_t j = 0; j < 4; ++j)
+        {
+            uint8_t const *const p = in + 8 * j;
+            out[j] = _mm256_setr_epi32(
+                palette[p[0]], palette[p[1]], palette[p[2]], palette[p[3]],
+                palette[p[4]], palette[p[5]], palette[p[6]], palette[p[7]]);
+        }
+        return;
+    }
+
+    /* Shuffles work within each 128-bit lane, so the low lane holds pixels
+     * 0-15 and the high lane pixels 16-31 throughout. */
+    __m256i const pr = _mm256_shuffle_epi8(planes->r, indices);
+    __m256i const pg = _mm256_shuffle_epi8(planes->g, indices);
+    __m256i const pb = _mm256_shuffle_epi8(planes->b, indices);
+    __m256i const pa = _mm256_shuffle_epi8(planes->a, indices);
+    __m256i const rg_lo = _mm256_unpacklo_epi8(pr, pg);
+    __m256i const rg_hi = _mm256_unpackhi_epi8(pr, pg);
+    __m256i const ba_lo = _mm256_unpacklo_epi8(pb, pa);
+    __m256i const ba_hi = _mm256_unpackhi_epi8(pb, pa);
+    __m256i const p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo);
+    __m256i const p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);
+    __m256i const p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi);
+    __m256i const p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);
+    out[0] = _mm256_permute2x128_si256(p0, p1, 0x20);
+    out[1] = _mm256_permute2x128_si256(p2, p3, 0x20);
+    out[2] = _mm256_permute2x128_si256(p0, p1, 0x31);
+    out[3] = _mm256_permute2x128_si256(p2, p3, 0x31);
+}
+
+/* Expands 32 pixels per step, using lookup32_avx2. */
+KERNELS_TARGET("avx2") void expand_avx2(
+    uint32_t *restrict out,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette)
+{
+    size_t i = 0;
+    if (n >= 32)
+    {
+        struct Planes_AVX2 const planes = planes_avx2(palette);
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i const indices = _mm256_loadu_si256(
+                (__m256i const *)(in + i));
+            __m256i pixels[4];
+            lookup32_avx2(pixels, indices, in + i, palette, &planes);
+            for (size_t j = 0; j < 4; ++j)
+                _mm256_storeu_si256((__m256i *)(out + i + 8 * j), pixels[j]);
+        }
+    }
+    expand_generic(out + i, in + i, n - i, palette);
+}
+
+/*
+ * Works on 32 pixels at a time, like expand_avx2.  Blocks which are all
+ * transparent are skipped, blocks with no transparent pixels are stored
+ * directly, and the rest use masked stores.
+ */
+KERNELS_TARGET("avx2") void blit_keyed_avx2(
+    uint32_t *restrict out,
+    uint32_t *restrict out2,
+    uint8_t const *restrict in,
+    size_t n,
+    uint32_t const *restrict palette,
+    uint8_t key)
+{
+    size_t i = 0;
+    if (n >= 32)
+    {
+        struct Planes_AVX2 const planes = planes_avx2(palette);
+        __m256i const keys = _mm256_set1_epi8((char)key);
+        for (; i + 32 <= n; i += 32)
+        {
+            __m256i const indices = _mm256_loadu_si256(
+                (__m256i const *)(in + i));
+            __m256i const transparent = _mm256_cmpeq_epi8(indices, keys);
+            uint32_t const transparent_bits = _mm256_movemask_epi8(
+                transparent);
+            if (transparent_bits == UINT32_MAX)
+                continue;
+
+            __m256i pixels[4];
+            lookup32_avx2(pixels, indices, in + i, palette, &planes);
+            if (transparent_bits == 0)
+            {
+                for (size_t j = 0; j < 4; ++j)
+                {
+                    size_t const at = i + 8 * j;
+                    _mm256_storeu_si256((__m256i *)(out + at), pixels[j]);
+                    if (out2 != NULL)
+                        _mm256_storeu_si256((__m256i *)(out2 + at), pixels[j]);
+                }
+                continue;
+            }
+
+            /* Widen the per-byte opacity mask to one per pixel. */
+            uint8_t opaque[32];
+            _mm256_storeu_si256(
+                (__m256i *)opaque,
+                _mm256_xor_si256(transparent, _mm256_set1_epi8((char)0xff)));
+            for (size_t j = 0; j < 4; ++j)
+            {
+                size_t const at = i + 8 * j;
+                __m256i const mask = _mm256_cvtepi8_epi32(
+                    _mm_loadl_epi64((__m128i const *)(opaque + 8 * j)));
+                _mm256_maskstore_epi32((int *)(out + at), mask, pixels[j]);
+                if (out2 != NULL)
+                    _mm256_maskstore_epi32((int *)(out2 + at), mask, pixels[j]);
+            }
+        }
+    }
+    blit_keyed_generic(
+        out + i, out2? out2 + i : NULL, in + i, n - i, palette, key);
+}
+
+static struct Kernels const kernels_avx2 = {
+    .cpu = Kernels_CPU_AVX2,
+    .expand = expand_avx2,
+    .blit_keyed = blit_keyed_avx2,
+};
+#endif /* KERNELS_X86 */
+
+
+/* ===[ Dispatch ]=== */
+struct Kernels const *kernels = &kernels_scalar;
+
+static char const *const cpu_names[] = {"scalar", "sse2", "avx2"};
+
+
+enum Kernels_CPU kernels_detect(void)
+{
+#if KERNELS_X86
+    __builtin_cpu_init();
+    /* The AVX2 kernels may also use BMI2, which every AVX2 CPU but a few
+     * early VIA ones has. */
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2"))
+        return Kernels_CPU_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return Kernels_CPU_SSE2;
+#endif
+    return Kernels_CPU_Scalar;
+}
+
+enum Kernels_CPU kernels_init(enum Kernels_CPU cpu)
+{
+    enum Kernels_CPU const best = kernels_detect();
+    if (cpu == Kernels_CPU_Auto || cpu > best)
+        cpu = best;
+
+    switch (cpu)
+    {
+#if KERNELS_X86
+    case Kernels_CPU_AVX2:
+        kernels = &kernels_avx2;
+        break;
+    case Kernels_CPU_SSE2:
+        kernels = &kernels_sse2;
+        break;
+#endif
+    default:
+        kernels = &kernels_scalar;
+        break;
+    }
+    return kernels->cpu;
+}
+
+char const *kernels_cpu_name(enum Kernels_CPU cpu)
+{
+    if (cpu == Kernels_CPU_Auto)
+        return "auto";
+    return cpu_names[cpu];
+}
+
+bool kernels_cpu_from_name(char const *name, enum Kernels_CPU *cpu)
+{
+    if (strcmp(name, "auto") == 0)
+    {
+        *cpu = Kernels_CPU_Auto;
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(cpu_names) / sizeof(*cpu_names); ++i)
+    {
+        if (strcmp(name, cpu_names[i]) == 0)
+        {
+            *cpu = i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,112 @@
+/*
+ * kernels.h -- CPU-specific pixel kernels.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_KERNELS_H
+#define GIFVIEW_KERNELS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * KERNELS_X86 is nonzero if x86 SIMD kernels are built, in which case
+ * KERNELS_TARGET(ISA) marks a function as compiled for the instruction set
+ * ISA, so it must only be called when the CPU supports it.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#define KERNELS_TARGET(isa)  __attribute__((target(isa)))
+#else
+#define KERNELS_X86 0
+#endif
+
+/**
+ * Instruction sets that kernels can be built for, from least to most capable.
+ * Each level implies the ones before it.
+ */
+enum Kernels_CPU
+{
+    /** Use the best level the CPU supports. */
+    Kernels_CPU_Auto = -1,
+    Kernels_CPU_Scalar,
+    Kernels_CPU_SSE2,
+    Kernels_CPU_AVX2,
+};
+
+/** A set of kernels built for one instruction set. */
+struct Kernels
+{
+    /** The instruction set these kernels use. */
+    enum Kernels_CPU cpu;
+
+    /**
+     * Look up N palette indices from IN in the 256-entry PALETTE, and write
+     * the resulting pixels to OUT.
+     */
+    void (*expand)(
+        uint32_t *restrict out,
+        uint8_t const *restrict in,
+        size_t n,
+        uint32_t const *restrict palette);
+
+    /**
+     * Like expand, but pixels whose index is KEY are transparent, so the
+     * pixel in OUT is left as it is.  If OUT2 isn't NULL, the same pixels are
+     * written to it too, in the same pass.
+     */
+    void (*blit_keyed)(
+        uint32_t *restrict out,
+        uint32_t *restrict out2,
+        uint8_t const *restrict in,
+        size_t n,
+        uint32_t const *restrict palette,
+        uint8_t key);
+};
+
+
+/**
+ * The kernels in use.  These are the scalar ones until kernels_init is
+ * called.
+ */
+extern struct Kernels const *kernels;
+
+
+/** Get the best instruction set the CPU supports. */
+enum Kernels_CPU kernels_detect(void);
+
+/**
+ * Select the kernels for CPU, or for the best instruction set supported if
+ * CPU is Kernels_CPU_Auto.  If the CPU doesn't support CPU, the best level
+ * below it is used instead.  Returns the level chosen.  This isn't thread
+ * safe, so it should be called once at startup.
+ */
+enum Kernels_CPU kernels_init(enum Kernels_CPU cpu);
+
+/** Get the name of CPU, as accepted by kernels_cpu_from_name. */
+char const *kernels_cpu_name(enum Kernels_CPU cpu);
+
+/**
+ * Parse an instruction set NAME ("auto", "scalar", "sse2" or "avx2") into
+ * CPU.  Returns false if NAME isn't recognized.
+ */
+bool kernels_cpu_from_name(char const *name, enum Kernels_CPU *cpu);
+
+
+#endif /* GIFVIEW_KERNELS_H */
@@ -0,0 +1,193 @@
+/*
+ * lz.c -- Fast LZ77 byte compression definitions.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "lz.h"
+
+#include <string.h>
+
+
+/** Shortest match worth storing. */
+#define LZ_MIN_MATCH    4
+
+/** Farthest back a match can copy from. */
+#define LZ_MAX_OFFSET   65535
+
+/** Size of the compressor's table of recently seen positions, in bits. */
+#define LZ_HASH_BITS    12
+
+
+/** Read 4 bytes from P. */
+static uint32_t _read32(uint8_t const *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+/** Hash the 4 bytes VALUE into an LZ_HASH_BITS index. */
+static size_t _hash(uint32_t value)
+{
+    return (uint32_t)(value * UINT32_C(2654435761)) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * Write the part of LENGTH that didn't fit in its token nibble to OUT,
+ * returning the new end of OUT.  Each byte adds up to 255; a byte less than
+ * 255 ends it.
+ */
+static uint8_t *_write_length(uint8_t *out, size_t length)
+{
+    if (length < 15)
+        return out;
+    for (length -= 15; length >= 255; length -= 255)
+        *out++ = 255;
+    *out++ = length;
+    return out;
+}
+
+/**
+ * Read the rest of a length whose token nibble was NIBBLE from *IN, which
+ * ends at END.  Returns false if the input runs out.
+ */
+static bool _read_length(
+    uint8_t const **in, uint8_t const *end, size_t nibble, size_t *length)
+{
+    *length = nibble;
+    if (nibble < 15)
+        return true;
+    for (;;)
+    {
+        if (*in == end)
+            return false;
+        uint8_t const byte = *(*in)++;
+        *length += byte;
+        if (byte != 255)
+            return true;
+    }
+}
+
+/**
+ * Write a sequence to OUT: LITERALS literal bytes from IN, then a match of
+ * MATCH bytes (if MATCH isn't 0) from OFFSET bytes back.  Returns the new end
+ * of OUT.
+ */
+static uint8_t *_write_sequence(
+    uint8_t *restrict out,
+    uint8_t const *restrict in, size_t literals,
+    size_t match, size_t offset)
+{
+    size_t const match_code = match? match - LZ_MIN_MATCH : 0;
+    *out++ = (
+        (literals < 15? literals : 15) << 4
+        | (match_code < 15? match_code : 15));
+    out = _write_length(out, literals);
+    memcpy(out, in, literals);
+    out += literals;
+    if (match)
+    {
+        *out++ = offset & 0xFF;
+        *out++ = offset >> 8;
+        out = _write_length(out, match_code);
+    }
+    return out;
+}
+
+
+size_t lz_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lz_compress(
+    uint8_t const *restrict in, size_t size, uint8_t *restrict out)
+{
+    /* Positions are stored plus one, so 0 means none. */
+    size_t table[1 << LZ_HASH_BITS] = {0};
+    uint8_t *const out_start = out;
+    size_t anchor = 0, pos = 0;
+    while (size >= LZ_MIN_MATCH && pos <= size - LZ_MIN_MATCH)
+    {
+        uint32_t const value = _read32(in + pos);
+        size_t const hash = _hash(value);
+        size_t const candidate = table[hash];
+        table[hash] = pos + 1;
+        if (candidate == 0
+            || pos - (candidate - 1) > LZ_MAX_OFFSET
+            || _read32(in + candidate - 1) != value)
+        {
+            ++pos;
+            continue;
+        }
+
+        size_t const from = candidate - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < size && in[from + length] == in[pos + length])
+            ++length;
+        out = _write_sequence(
+            out, in + anchor, pos - anchor, length, pos - from);
+        pos += length;
+        anchor = pos;
+    }
+    out = _write_sequence(out, in + anchor, size - anchor, 0, 0);
+    return out - out_start;
+}
+
+bool lz_decompress(
+    uint8_t const *restrict in, size_t in_size,
+    uint8_t *restrict out, size_t out_size)
+{
+    uint8_t const *p = in;
+    uint8_t const *const end = in + in_size;
+    size_t written = 0;
+    while (p != end)
+    {
+        uint8_t const token = *p++;
+        size_t literals;
+        if (!_read_length(&p, end, token >> 4, &literals)
+            || literals > (size_t)(end - p)
+            || literals > out_size - written)
+        {
+            return false;
+        }
+        memcpy(out + written, p, literals);
+        p += literals;
+        written += literals;
+        /* Only the last sequence has no match. */
+        if (p == end)
+            break;
+
+        if (end - p < 2)
+            return false;
+        size_t const offset = p[0] | (size_t)p[1] << 8;
+        p += 2;
+        size_t match;
+        if (!_read_length(&p, end, token & 0x0F, &match))
+            return false;
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > written || match > out_size - written)
+            return false;
+        /* Byte by byte, since a match can overlap the bytes it makes. */
+        uint8_t const *src = out + written - offset;
+        for (size_t i = 0; i < match; ++i)
+            out[written + i] = src[i];
+        written += match;
+    }
+    return written == out_size;
+}
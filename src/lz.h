@@ -0,0 +1,56 @@
+/*
+ * lz.h -- Fast LZ77 byte compression declarations.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef GIFVIEW_LZ_H
+#define GIFVIEW_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Most bytes lz_compress can turn SIZE bytes into.  Data that doesn't
+ * compress grows by a little under 1 byte in 255.
+ */
+size_t lz_bound(size_t size);
+
+/**
+ * Compress the SIZE bytes IN into OUT, which must have room for lz_bound(SIZE)
+ * bytes.  Returns the compressed size.
+ *
+ * The data is stored as a series of sequences, each a run of literal bytes
+ * followed by a match: a copy of earlier output, up to 65535 bytes back.  The
+ * last sequence is literals alone.  This is quick to decode and does well on
+ * long runs of the same bytes or pixels, as flat areas of frames have.
+ */
+size_t lz_compress(
+    uint8_t const *restrict in, size_t size, uint8_t *restrict out);
+
+/**
+ * Decompress the IN_SIZE bytes IN into the OUT_SIZE byte buffer OUT.  Returns
+ * false if IN is malformed or doesn't decompress to exactly OUT_SIZE bytes.
+ */
+bool lz_decompress(
+    uint8_t const *restrict in, size_t in_size,
+    uint8_t *restrict out, size_t out_size);
+
+
+#endif /* GIFVIEW_LZ_H */
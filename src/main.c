@@ -20,18 +20,23 @@
 
 #include "args.h"
 #include "keybinds.h"
+#include "probe.h"
 #include "sdlapp.h"
 #include "sdlgif.h"
 #include "viewer/viewer.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <SDL2/SDL.h>
 #include <SDL_ttf.h>
 
 
 #if _WIN32
+#include <fcntl.h>
+#include <io.h>
 #define MAIN SDL_main
 #else
 #define MAIN main
@@ -46,6 +51,12 @@ enum UserEventCode
 };
 
 
+/** Log MESSAGE from the gif library, at LEVEL. */
+void log_gif_message(void *user, enum GIF_LogLevel level, char const *message);
+
+/** Print the memory statistics STATS of loading a GIF to stderr. */
+void print_alloc_stats(struct GIF_AllocStats const *stats);
+
 /** Temporarily display app state text. */
 void show_app_text_temporarily(struct App *app);
 
@@ -186,6 +197,34 @@ struct Action actions[] = {
 size_t actions_count = sizeof(actions) / sizeof(*actions);
 
 
+void log_gif_message(void *user, enum GIF_LogLevel level, char const *message)
+{
+    (void)user;
+    switch (level)
+    {
+    case GIF_LogLevel_Warning:
+        warn("%s\n", message);
+        break;
+    case GIF_LogLevel_Error:
+        error("%s\n", message);
+        break;
+    }
+}
+
+void print_alloc_stats(struct GIF_AllocStats const *stats)
+{
+    fprintf(
+        stderr, "Memory: %zu allocations, %zu bytes (peak %zu)\n",
+        stats->allocations, stats->bytes, stats->peak_bytes);
+    for (size_t i = 0; i < GIF_AllocCategory_Count; ++i)
+    {
+        fprintf(
+            stderr, "  %-12s %zu bytes (peak %zu)\n",
+            gif_alloc_category_name(i),
+            stats->category_bytes[i], stats->category_peak_bytes[i]);
+    }
+}
+
 void show_app_text_temporarily(struct App *app)
 {
     static Uint32 const DISPLAY_TIME_MILLISECONDS = 1000;
@@ -234,15 +273,64 @@ Uint32 hideapptext_callback(Uint32 interval, void *param)
 
 int MAIN(int argc, char *argv[])
 {
-    char const *const filename = parse_args(argc, argv);
-    GIF gif = gif_from_file(filename);
+    struct Args const args = parse_args(argc, argv);
+    char const *const filename = args.filename;
 
-    for (LinkedList *node = gif.comments; node != NULL; node = node->next)
-        printf("Comment: '%s'\n", (char const *)node->data);
+    enum Kernels_CPU const cpu = kernels_init(args.cpu);
+    if (args.cpu != Kernels_CPU_Auto && cpu != args.cpu)
+    {
+        warn("CPU doesn't support %s, using %s instead\n",
+            kernels_cpu_name(args.cpu), kernels_cpu_name(cpu));
+    }
 
-    for (LinkedList *node = gif.app_extensions; node != NULL; node = node->next)
+    unsigned const threads = args.threads? args.threads : SDL_GetCPUCount();
+    if (args.probe)
     {
-        struct GIF_ApplicationExt const *ext = node->data;
+        bool const ok = probe_files(args.filenames, args.file_count, threads);
+        return ok? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* Must outlive the GIF, which keeps allocating through it. */
+    struct GIF_CountingAllocator counter;
+    gif_counting_allocator_init(&counter, NULL);
+
+    struct GIF_LoadOptions const load_options = {
+        .expand_opaque_images = true,
+        .threads = threads,
+        .lazy = args.frame_cache_mb != 0,
+        .allocator = args.alloc_stats? &counter.allocator : NULL,
+        .log = log_gif_message,
+        .log_user = NULL,
+    };
+    GIF gif;
+    enum GIF_Status status;
+    if (strcmp(filename, "-") == 0)
+    {
+#if _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        status = gif_from_fd(fileno(stdin), &load_options, &gif);
+    }
+    else
+        status = gif_from_file(filename, &load_options, &gif);
+    if (status == GIF_Status_ReadError)
+        fatal("%s: %s\n", filename, strerror(errno));
+    /* Show as much of a damaged GIF as could be loaded. */
+    if (status != GIF_Status_OK)
+    {
+        if (gif.graphic_count == 0)
+            fatal("%s: %s\n", filename, gif_status_message(status));
+        warn("%s: %s\n", filename, gif_status_message(status));
+    }
+    if (args.alloc_stats)
+        print_alloc_stats(&counter.stats);
+
+    for (size_t i = 0; i < gif.comment_count; ++i)
+        printf("Comment: '%s'\n", gif.comments[i]);
+
+    for (size_t i = 0; i < gif.app_extension_count; ++i)
+    {
+        struct GIF_ApplicationExt const *ext = &gif.app_extensions[i];
         printf("App Extension: %.8s%.3s (%zu data bytes)\n",
             ext->appid, ext->auth_code, ext->data_size);
     }
@@ -255,7 +343,21 @@ int MAIN(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    struct App *G = app_new(&gif, filename);
+    struct GraphicList_Options const frame_options = {
+        .cache_limit = args.frame_cache_mb * 1024 * 1024,
+        .lossy = args.rgb565,
+        .compress = args.compress_frames,
+        .merge = args.merge_frames,
+    };
+    struct App *G = app_new(&gif, filename, &frame_options);
+    if (args.alloc_stats && args.frame_cache_mb == 0)
+    {
+        fprintf(
+            stderr, "Frames: %zu bytes, stored as %s%s\n",
+            G->images.store.bytes,
+            framestore_format_name(G->images.store.format),
+            G->images.store.cold? ", compressed" : "");
+    }
 
     keybinds_init();
 
@@ -0,0 +1,341 @@
+/*
+ * probe.c -- Headless GIF metadata probing definitions.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "probe.h"
+#include "gif/filemap.h"
+#include "gif/gif.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+
+/**
+ * A growable string.  If memory for it runs out, DATA is freed and FAILED is
+ * set, and anything appended after that is dropped.
+ */
+struct Buffer
+{
+    char *data;
+    size_t length, allocated;
+    bool failed;
+};
+
+/** One file's probe result, filled in by a worker. */
+struct ProbeResult
+{
+    /** True once the file has been probed. */
+    bool done;
+    /** The file's JSON line, or NULL if there wasn't memory for it. */
+    char *line;
+    bool ok;
+};
+
+/**
+ * Files shared between the probing threads.  Workers take the next file to
+ * probe from NEXT_FILE, and signal DONE when a result is ready.
+ */
+struct ProbePool
+{
+    char const *const *filenames;
+    struct ProbeResult *results;
+    size_t count;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    size_t next_file;
+};
+
+
+/**
+ * Make room in BUF for LENGTH more bytes, plus a NUL terminator.  Returns
+ * false if BUF has failed.
+ */
+bool buffer_reserve(struct Buffer *buf, size_t length)
+{
+    if (buf->failed)
+        return false;
+    if (buf->length + length + 1 <= buf->allocated)
+        return true;
+    size_t allocated = buf->allocated? buf->allocated : 256;
+    while (buf->length + length + 1 > allocated)
+        allocated *= 2;
+    char *const data = realloc(buf->data, allocated);
+    if (data == NULL)
+    {
+        free(buf->data);
+        buf->data = NULL;
+        buf->failed = true;
+        return false;
+    }
+    buf->data = data;
+    buf->allocated = allocated;
+    return true;
+}
+
+/** Append LENGTH bytes of STR to BUF. */
+void buffer_append(
+    struct Buffer *restrict buf, char const *restrict str, size_t length)
+{
+    if (!buffer_reserve(buf, length))
+        return;
+    memcpy(buf->data + buf->length, str, length);
+    buf->length += length;
+    buf->data[buf->length] = '\0';
+}
+
+/** Append the printf-style FMT to BUF. */
+void buffer_printf(struct Buffer *restrict buf, char const *restrict fmt, ...)
+{
+    va_list ap, ap2;
+    va_start(ap, fmt);
+    va_copy(ap2, ap);
+
+    int const count = vsnprintf(NULL, 0, fmt, ap);
+    if (buffer_reserve(buf, count))
+    {
+        vsnprintf(buf->data + buf->length, count + 1, fmt, ap2);
+        buf->length += count;
+    }
+
+    va_end(ap);
+    va_end(ap2);
+}
+
+/**
+ * Append the LENGTH bytes of STR to BUF as a quoted JSON string.  Bytes are
+ * passed through as they are, other than quotes, backslashes and control
+ * characters, which are escaped.
+ */
+void buffer_append_json_string(
+    struct Buffer *restrict buf, char const *restrict str, size_t length)
+{
+    buffer_append(buf, "\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        unsigned char const c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7F)
+            continue;
+        buffer_append(buf, str + run, i - run);
+        run = i + 1;
+        switch (c)
+        {
+        case '"':   buffer_append(buf, "\\\"", 2); break;
+        case '\\':  buffer_append(buf, "\\\\", 2); break;
+        case '\n':  buffer_append(buf, "\\n", 2); break;
+        case '\r':  buffer_append(buf, "\\r", 2); break;
+        case '\t':  buffer_append(buf, "\\t", 2); break;
+        default:    buffer_printf(buf, "\\u%.4x", c); break;
+        }
+    }
+    buffer_append(buf, str + run, length - run);
+    buffer_append(buf, "\"", 1);
+}
+
+
+/**
+ * Probe the GIF named FILENAME, putting its JSON line in RESULT.  Only the
+ * file's block structure is read, using gif_index_scan.  Runs on the probing
+ * threads, so failures go in RESULT rather than ending the program.
+ */
+void probe_file(
+    char const *restrict filename, struct ProbeResult *restrict result)
+{
+    struct Buffer buf = {
+        .data = NULL, .length = 0, .allocated = 0, .failed = false};
+    buffer_append(&buf, "{\"file\":", 8);
+    buffer_append_json_string(&buf, filename, strlen(filename));
+
+    struct FileMap map;
+    if (!filemap_open(&map, filename))
+    {
+        char message[256];
+        if (strerror_r(errno, message, sizeof(message)) != 0)
+            snprintf(message, sizeof(message), "error %d", errno);
+        buffer_append(&buf, ",\"error\":", 9);
+        buffer_append_json_string(&buf, message, strlen(message));
+        buffer_append(&buf, "}\n", 2);
+        result->line = buf.data;
+        result->ok = false;
+        return;
+    }
+    if (map.size < 6 || memcmp(map.data, "GIF", 3) != 0)
+    {
+        buffer_append(&buf, ",\"error\":\"not a GIF file\"}\n", 27);
+        filemap_close(&map);
+        result->line = buf.data;
+        result->ok = false;
+        return;
+    }
+
+    struct GIF_Index index;
+    bool const complete = gif_index_scan(map.data, map.size, &index);
+
+    size_t frames = 0;
+    uint64_t duration = 0;
+    for (size_t i = 0; i < index.count; ++i)
+    {
+        struct GIF_IndexEntry const *const entry = &index.entries[i];
+        if (entry->is_img)
+            frames++;
+        if (entry->has_extension)
+            duration += entry->extension.delay_time;
+    }
+
+    buffer_printf(
+        &buf, ",\"width\":%u,\"height\":%u,\"frames\":%zu,\"duration_ms\":%llu",
+        (unsigned)index.width, (unsigned)index.height, frames,
+        (unsigned long long)duration * 10);
+    if (index.loop_count < 0)
+        buffer_append(&buf, ",\"loop_count\":null", 18);
+    else
+        buffer_printf(&buf, ",\"loop_count\":%ld", (long)index.loop_count);
+
+    buffer_append(&buf, ",\"comments\":[", 13);
+    for (size_t i = 0; i < index.comment_count; ++i)
+    {
+        char *const comment = gif_index_comment(
+            map.data, map.size, index.comment_offsets[i]);
+        if (comment == NULL)
+        {
+            /* Out of memory: there's no line without the comment. */
+            free(buf.data);
+            buf.data = NULL;
+            buf.failed = true;
+            break;
+        }
+        if (i != 0)
+            buffer_append(&buf, ",", 1);
+        buffer_append_json_string(&buf, comment, strlen(comment));
+        free(comment);
+    }
+    buffer_printf(
+        &buf, "],\"complete\":%s}\n", complete? "true" : "false");
+
+    gif_index_free(&index);
+    filemap_close(&map);
+    result->line = buf.data;
+    /* A file that couldn't be scanned to the end is reported as a failure,
+     * so scripts checking files by exit status catch it. */
+    result->ok = complete && !buf.failed;
+}
+
+/** Probe files from the pool ARG until there are none left. */
+void *probepool_worker(void *arg)
+{
+    struct ProbePool *const pool = arg;
+    for(;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        size_t const i = pool->next_file++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count)
+            break;
+
+        struct ProbeResult result;
+        probe_file(pool->filenames[i], &result);
+        result.done = true;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->results[i] = result;
+        pthread_cond_broadcast(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+
+bool probe_files(char const *const *filenames, size_t count, unsigned threads)
+{
+    errno = 0;
+    struct ProbeResult *results = calloc(count, sizeof(*results));
+    if (count != 0 && results == NULL)
+        fatal("calloc: %s\n", strerror(errno));
+
+    struct ProbePool pool = {
+        .filenames = filenames,
+        .results = results,
+        .count = count,
+        .next_file = 0,
+    };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done, NULL);
+
+    size_t thread_count = threads? threads : 1;
+    if (thread_count > count)
+        thread_count = count;
+    errno = 0;
+    pthread_t *workers = malloc(thread_count * sizeof(*workers));
+    if (thread_count != 0 && workers == NULL)
+    {
+        warn("malloc: %s\n", strerror(errno));
+        thread_count = 0;
+    }
+
+    size_t started = 0;
+    for (; started < thread_count; ++started)
+    {
+        int const err = pthread_create(
+            workers + started, NULL, probepool_worker, &pool);
+        if (err != 0)
+        {
+            warn("pthread_create: %s\n", strerror(err));
+            break;
+        }
+    }
+    /* With no workers, probe everything here before printing. */
+    if (started == 0)
+        probepool_worker(&pool);
+
+    /* Print the results in order, as soon as each one is ready. */
+    bool ok = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        pthread_mutex_lock(&pool.lock);
+        while (!results[i].done)
+            pthread_cond_wait(&pool.done, &pool.lock);
+        pthread_mutex_unlock(&pool.lock);
+
+        if (results[i].line == NULL)
+            warn("%s: out of memory\n", filenames[i]);
+        else
+        {
+            fputs(results[i].line, stdout);
+            fflush(stdout);
+        }
+        ok = ok && results[i].ok;
+        free(results[i].line);
+    }
+
+    for (size_t i = 0; i < started; ++i)
+        pthread_join(workers[i], NULL);
+    free(workers);
+    free(results);
+    pthread_cond_destroy(&pool.done);
+    pthread_mutex_destroy(&pool.lock);
+    return ok;
+}
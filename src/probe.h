@@ -0,0 +1,36 @@
+/*
+ * probe.h -- Headless GIF metadata probing declarations.
+ *
+ * Copyright (C) 2022-2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_PROBE_H
+#define GIFVIEW_PROBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/**
+ * Print the metadata of the COUNT GIFs named by FILENAMES to stdout, as one
+ * line of JSON each, in the order given.  No image data is decoded.  Files
+ * are probed by up to THREADS threads at once.  Returns false if any file
+ * couldn't be probed.
+ */
+bool probe_files(char const *const *filenames, size_t count, unsigned threads);
+
+
+#endif /* GIFVIEW_PROBE_H */
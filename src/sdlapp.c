@@ -38,7 +38,8 @@ static uint8_t const BACKGROUND_GRID_COLOR_B[3] = {0x90, 0x90, 0x90};
 /** Get transformed rect for the current frame. */
 SDL_Rect _get_current_frame_rect(struct App const *app)
 {
-    struct SDLGraphic const *const img = app->current_frame->data;
+    struct SDLGraphic const *const img = (
+        &app->images.frames[app->current_frame]);
     int const img_scaled_h = img->height * app->view.transform.zoom;
     int const img_scaled_w = img->width * app->view.transform.zoom;
     SDL_Rect rect;
@@ -89,7 +90,7 @@ void _generate_bg_grid(struct App *app)
 /** Returns true if the app is on the final frame, false otherwise. */
 bool _is_app_on_final_frame(struct App const *app)
 {
-    return app->current_frame->next == app->images;
+    return app->current_frame + 1 == app->images.count;
 }
 
 /** Draw app overlay text. */
@@ -129,7 +130,9 @@ void menu_cb_toggle_looping(void *data)
     app_set_looping(app, !app->view.looping);
 }
 
-struct App *app_new(GIF const *gif, char const *path)
+struct App *app_new(
+    GIF const *gif, char const *path,
+    struct GraphicList_Options const *frame_options)
 {
     struct App *app = malloc(sizeof(struct App));
 
@@ -178,15 +181,13 @@ struct App *app_new(GIF const *gif, char const *path)
     app->view.transform.offset_y = 0;
     app->view.transform.zoom = 1.0;
 
-    app->images = graphiclist_new_from_gif(app->renderer, *gif);
-    app->current_frame = app->images;
+    app->images = graphiclist_new_from_gif(
+        app->renderer, gif, frame_options);
+    app->current_frame = 0;
     app->timer = 0;
     app->full_time = 0;
-    for (GraphicList curr = app->images; curr->next != app->images; curr = curr->next)
-    {
-        struct SDLGraphic const *const img = curr->data;
-        app->full_time += img->delay;
-    }
+    for (size_t i = 0; i + 1 < app->images.count; ++i)
+        app->full_time += app->images.frames[i].delay;
     app->state_text_visible = false;
     app->is_fullscreen = false;
 
@@ -242,9 +243,10 @@ bool app_timer_increment(struct App *app)
     bool advanced = false;
     app->timer = fmod(app->timer + app->view.playback_speed, app->full_time);
     for (
-        struct SDLGraphic const *image = app->current_frame->data;
+        struct SDLGraphic const *image = (
+            &app->images.frames[app->current_frame]);
         app->timer >= image->delay;
-        image = app->current_frame->data)
+        image = &app->images.frames[app->current_frame])
     {
         if (_is_app_on_final_frame(app) && !app->view.looping)
             break;
@@ -259,25 +261,25 @@ bool app_timer_increment(struct App *app)
 
 void app_next_frame(struct App *app)
 {
-    struct SDLGraphic const *const image = app->current_frame->data;
+    struct SDLGraphic const *const image = (
+        &app->images.frames[app->current_frame]);
     app->timer -= image->delay;
-    app->current_frame = app->current_frame->next;
+    app->current_frame = (app->current_frame + 1) % app->images.count;
 }
 
 void app_previous_frame(struct App *app)
 {
-    GraphicList current = app->current_frame;
-    /* TODO: Switch to doubly-linked lists to simplify. */
-    while (app->current_frame->next != current)
-        app_next_frame(app);
+    app->current_frame = (
+        (app->current_frame + app->images.count - 1) % app->images.count);
     app->timer = 0;
 }
 
 void app_draw(struct App *app)
 {
-    struct SDLGraphic const *const img = app->current_frame->data;
+    SDL_Texture *const texture = graphiclist_get_texture(
+        &app->images, app->current_frame);
     SDL_Rect const position = _get_current_frame_rect(app);
-    SDL_RenderCopy(app->renderer, img->texture, NULL, &position);
+    SDL_RenderCopy(app->renderer, texture, NULL, &position);
     menu_draw(app->menu);
     if (app->state_text_visible)
         _draw_text_overlay(app);
@@ -39,7 +39,9 @@ struct App
     struct TextRenderer *paused_text, *looping_text, *playback_speed_text;
     int width, height;
     struct Viewer view;
-    GraphicList images, current_frame;
+    GraphicList images;
+    /** Index into IMAGES of the frame being shown. */
+    size_t current_frame;
     Menu *menu;
     MenuButton *pause_btn;
     MenuButton *looping_btn;
@@ -54,8 +56,14 @@ struct App
 };
 
 
-/** Create SDL data. */
-struct App *app_new(GIF const *gif, char const *path);
+/**
+ * Create SDL data.  Frames are made as FRAME_OPTIONS says (see
+ * graphiclist_new_from_gif); if they're made as they're shown, GIF must
+ * outlive the app.
+ */
+struct App *app_new(
+    GIF const *gif, char const *path,
+    struct GraphicList_Options const *frame_options);
 
 /** Free SDL data. */
 void app_free(struct App const *app);
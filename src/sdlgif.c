@@ -19,7 +19,10 @@
 
 #include "sdlgif.h"
 #include "font.h"
+#include "kernels/kernels.h"
 
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <SDL_ttf.h>
@@ -28,6 +31,23 @@
 #define MIN(a, b)   (a < b? a : b)
 
 
+/**
+ * Most frames a GraphicList's FrameStore goes between keyframes.  Getting to
+ * a frame means redrawing at most this many changed rects.
+ */
+static size_t const KEYFRAME_INTERVAL = 16;
+
+/** Frames past the one shown to keep decompressed, if frames are compressed. */
+static size_t const DECOMPRESS_AHEAD = 16;
+
+/**
+ * Fewest frames between a lazy GraphicList's basis snapshots.  Going back a
+ * frame means redrawing at most this many frames, or more if a quarter of
+ * the cache can't hold a snapshot this often.
+ */
+static size_t const SNAPSHOT_INTERVAL = 16;
+
+
 /**
  * Interstitial structure used to construct the full frames contained in the
  * SDLGraphic struct.  SDL representation of a GIF_Graphic.
@@ -49,23 +69,35 @@ sdl_color_get_from_colortable(struct GIF_ColorTable const *table, size_t index)
     return color;
 }
 
-/** Convert a GIF_ColorTable to a list of SDL_Colors. */
-SDL_Color *sdl_color_list_from_colortable(struct GIF_ColorTable const *table)
-{
-    SDL_Color *const colors = malloc(sizeof(SDL_Color) * table->size);
-    for (size_t i = 0; i < table->size; ++i)
-        colors[i] = sdl_color_get_from_colortable(table, i);
-    return colors;
-}
-
 /** Create a SurfaceGraphic from a GIF_Image. */
 struct SurfaceGraphic *surfacegraphic_from_image(struct GIF_Image const *image)
 {
     struct SurfaceGraphic *const out = malloc(sizeof(*out));
+    if (out == NULL)
+        fatal("malloc: %s\n", strerror(errno));
     out->rect.x = image->left;
     out->rect.y = image->top;
     out->rect.w = image->width;
     out->rect.h = image->height;
+    if (image->format == GIF_PixelFormat_RGBA32)
+    {
+        /* Already expanded to RGBA by the loader, and fully opaque. */
+        out->surface = SDL_CreateRGBSurfaceWithFormatFrom(
+            image->pixels,
+            image->width, image->height,
+            32,
+            image->width * 4,
+            SDL_PIXELFORMAT_RGBA32);
+        if (out->surface == NULL)
+        {
+            error("SDL_CreateRGBSurfaceWithFormatFrom -- %s\n", SDL_GetError());
+            free(out);
+            return NULL;
+        }
+        SDL_SetSurfaceBlendMode(out->surface, SDL_BLENDMODE_NONE);
+        return out;
+    }
+
     out->surface = SDL_CreateRGBSurfaceWithFormatFrom(
         image->pixels,
         image->width, image->height,
@@ -87,16 +119,65 @@ struct SurfaceGraphic *surfacegraphic_from_image(struct GIF_Image const *image)
         return out;
     }
 
-    SDL_Color *const colors = sdl_color_list_from_colortable(table);
+    /* SDL_Colors are R, G, B, A bytes, just like the table's RGBA pixels. */
     int const err = SDL_SetPaletteColors(
-        out->surface->format->palette, colors, 0, table->size);
+        out->surface->format->palette, (SDL_Color const *)table->rgba,
+        0, table->size);
     if (err != 0)
         error("SDL_SetPaletteColors -- %s\n", SDL_GetError());
-    free(colors);
 
     return out;
 }
 
+/**
+ * Draw the indexed IMAGE onto the RGBA32 surface DST, looking its pixels up in
+ * the 256-entry PALETTE.  If DST2 isn't NULL, the image is drawn onto it too
+ * in the same pass, so it must be the same size as DST.  If EXTENSION gives
+ * a transparent index, those pixels are left alone.  The image is clipped to
+ * DST, like SDL_BlitSurface.
+ */
+void draw_indexed_image(
+    SDL_Surface *restrict dst,
+    SDL_Surface *restrict dst2,
+    struct GIF_Image const *restrict image,
+    struct GIF_GraphicExt const *restrict extension,
+    uint32_t const *restrict palette)
+{
+    if (image->left >= dst->w || image->top >= dst->h)
+        return;
+    int const width = MIN(image->width, dst->w - image->left);
+    int const height = MIN(image->height, dst->h - image->top);
+    bool const keyed = extension && extension->transparent_color_flag;
+
+    SDL_LockSurface(dst);
+    if (dst2)
+        SDL_LockSurface(dst2);
+    uint8_t const *src = image->pixels;
+    for (int y = image->top; y < image->top + height; ++y)
+    {
+        uint32_t *const out = (uint32_t *)(
+            (uint8_t *)dst->pixels + y * dst->pitch) + image->left;
+        uint32_t *const out2 = dst2? (uint32_t *)(
+            (uint8_t *)dst2->pixels + y * dst2->pitch) + image->left : NULL;
+        if (keyed)
+        {
+            kernels->blit_keyed(
+                out, out2, src, width, palette,
+                extension->transparent_color_idx);
+        }
+        else
+        {
+            kernels->expand(out, src, width, palette);
+            if (out2)
+                memcpy(out2, out, width * sizeof(*out));
+        }
+        src += image->width;
+    }
+    if (dst2)
+        SDL_UnlockSurface(dst2);
+    SDL_UnlockSurface(dst);
+}
+
 /** Fit the font to the given width/height. */
 int fit_font_to_rect(int width, int height)
 {
@@ -124,6 +205,8 @@ struct SurfaceGraphic *surfacegraphic_from_plaintext(
     struct GIF_ColorTable const *restrict gct)
 {
     struct SurfaceGraphic *out = malloc(sizeof(*out));
+    if (out == NULL)
+        fatal("malloc: %s\n", strerror(errno));
     out->rect.x = plaintext->tg_left;
     out->rect.y = plaintext->tg_top;
     out->rect.w = plaintext->tg_width;
@@ -155,12 +238,40 @@ struct SurfaceGraphic *surfacegraphic_from_plaintext(
     return out;
 }
 
-/** Create a SurfaceGraphic from a GIF_Graphic. */
+/**
+ * Returns true if GRAPHIC is an indexed image which can be drawn straight into
+ * frames with the pixel kernels, instead of going through SDL's colorkey
+ * blit.
+ */
+bool graphic_is_indexed(struct GIF_Graphic const *graphic)
+{
+    return (
+        graphic->is_img
+        && graphic->img.format == GIF_PixelFormat_Index8
+        && graphic->img.color_table != NULL);
+}
+
+/**
+ * Create a SurfaceGraphic from a GIF_Graphic.  Indexed images (see
+ * graphic_is_indexed) are never blitted, so they only get a rect, and no
+ * surface.
+ */
 struct SurfaceGraphic *surfacegraphic_from_graphic(
     struct GIF_Graphic const *restrict graphic,
     struct GIF_ColorTable const *restrict gct)
 {
     struct SurfaceGraphic *out = NULL;
+    if (graphic_is_indexed(graphic))
+    {
+        out = malloc(sizeof(*out));
+        if (out == NULL)
+            fatal("malloc: %s\n", strerror(errno));
+        out->rect = (SDL_Rect){
+            .x = graphic->img.left, .y = graphic->img.top,
+            .w = graphic->img.width, .h = graphic->img.height};
+        out->surface = NULL;
+        return out;
+    }
     if (graphic->is_img)
         out = surfacegraphic_from_image(&graphic->img);
     else
@@ -187,69 +298,161 @@ void surfacegraphic_free(struct SurfaceGraphic *sg)
 }
 
 
-/** Allocate a new SDLGraphic. */
-struct SDLGraphic *graphic_new(void)
+/** Free the texture held by an SDLGraphic. */
+void graphic_free(struct SDLGraphic *graphic)
 {
-    struct SDLGraphic *graphic = malloc(sizeof(struct SDLGraphic));
-    graphic->delay = 0;
-    graphic->width = 0;
-    graphic->height = 0;
-    graphic->texture = NULL;
-    return graphic;
+    if (graphic->texture)
+        SDL_DestroyTexture(graphic->texture);
 }
 
-/** Free an SDLGraphic. */
-void graphic_free(struct SDLGraphic *graphic)
+
+/**
+ * Find the last graphic of the frame of GIF starting at graphic START.  Frames
+ * end at the first graphic with a nonzero delay time.
+ */
+size_t _frame_last_graphic(GIF const *gif, size_t start)
+{
+    for (; start + 1 < gif->graphic_count; ++start)
+    {
+        struct GIF_Graphic const *const graphic = &gif->graphics[start];
+        if (graphic->extension && graphic->extension->delay_time != 0)
+            break;
+    }
+    return start;
+}
+
+/**
+ * Returns true if one of GIF's graphics FIRST through LAST is an image
+ * covering the whole canvas with no transparency, so the frame they make
+ * doesn't depend on the frames before it.
+ */
+bool _frame_covers_canvas(GIF const *gif, size_t first, size_t last)
+{
+    for (size_t i = first; i <= last; ++i)
+    {
+        struct GIF_Graphic const *const graphic = &gif->graphics[i];
+        struct GIF_Image const *const image = &graphic->img;
+        bool const opaque = !(
+            graphic->extension && graphic->extension->transparent_color_flag);
+        if (graphic->is_img && opaque
+            && image->left == 0 && image->top == 0
+            && image->width == gif->width && image->height == gif->height)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Copy the COUNT graphics of GIF starting at FIRST into a new array, decoding
+ * the images of a lazily loaded GIF into new pixel buffers.  Free it with
+ * _free_frame_graphics.
+ */
+struct GIF_Graphic *_get_frame_graphics(
+    GIF const *gif, size_t first, size_t count)
 {
-    SDL_DestroyTexture(graphic->texture);
-    free(graphic);
+    struct GIF_Graphic *const graphics = malloc(count * sizeof(*graphics));
+    if (graphics == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    memcpy(graphics, gif->graphics + first, count * sizeof(*graphics));
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct GIF_Image *const image = &graphics[i].img;
+        if (!graphics[i].is_img || image->pixels != NULL)
+            continue;
+        /* Images the loader couldn't get to are left blank. */
+        image->pixels = calloc(image->size? image->size : 1, 1);
+        if (image->pixels == NULL)
+            fatal("calloc: %s\n", strerror(errno));
+        if (image->data != NULL)
+            gif_image_decode(image, image->pixels, NULL);
+    }
+    return graphics;
 }
 
+/** Free the COUNT GRAPHICS from _get_frame_graphics, copied from GIF. */
+void _free_frame_graphics(
+    GIF const *restrict gif, size_t first, size_t count,
+    struct GIF_Graphic *restrict graphics)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (graphics[i].is_img
+            && graphics[i].img.pixels != gif->graphics[first + i].img.pixels)
+        {
+            free(graphics[i].img.pixels);
+        }
+    }
+    free(graphics);
+}
 
 /**
- * Construct a frame of a GIF.  START will be updated to point to the
- * last processed graphic.  NEXTFRAME will be updated to contain the basis for
- * the next frame.
+ * Construct a frame of a GIF, starting from the graphic at index START.  START
+ * will be updated to the index of the last processed graphic.  NEXTFRAME will
+ * be updated to contain the basis for the next frame.
  */
 SDL_Surface *
 _make_frame(
-    LinkedList const **restrict start,
+    size_t *restrict start,
     SDL_Surface **restrict nextframe,
     GIF const *restrict gif)
 {
-    LinkedList const *const start_orig = *start;
-    LinkedList *surfacegraphics = NULL;
+    size_t const start_orig = *start;
+    *start = _frame_last_graphic(gif, start_orig);
+
+    size_t const count = *start - start_orig + 1;
+    struct GIF_Graphic *const graphics = _get_frame_graphics(
+        gif, start_orig, count);
+    struct GIF_Graphic const *const graphic = &graphics[count - 1];
+    struct SurfaceGraphic **const surfacegraphics = malloc(
+        count * sizeof(*surfacegraphics));
+    if (surfacegraphics == NULL)
+        fatal("malloc: %s\n", strerror(errno));
+    for (size_t i = 0; i < count; ++i)
+    {
+        surfacegraphics[i] = surfacegraphic_from_graphic(
+            &graphics[i], gif->global_color_table);
+    }
 
-    /* Step through graphics until we find a graphic with a nonzero delay time,
-     * which marks the start of a new frame. */
-    for (; (*start)->next != NULL; *start = (*start)->next)
+    /* A frame made of a single image that the loader already decoded to
+     * RGBA covers the whole canvas opaquely, so its pixels can be used as the
+     * frame directly.  Images decoded just for this frame are freed
+     * afterwards, so they can't be. */
+    bool const direct = (
+        *start == start_orig
+        && graphic->is_img
+        && graphic->img.format == GIF_PixelFormat_RGBA32
+        && graphic->img.pixels == gif->graphics[*start].img.pixels);
+
+    SDL_Surface *frame = NULL;
+    if (direct)
     {
-        struct GIF_Graphic const *const graphic = (*start)->data;
-        struct SurfaceGraphic *g = surfacegraphic_from_graphic(
-            graphic, gif->global_color_table);
-        linkedlist_append(&surfacegraphics, linkedlist_new(g));
-        if (graphic->extension && graphic->extension->delay_time != 0)
-            break;
+        frame = SDL_CreateRGBSurfaceWithFormatFrom(
+            graphic->img.pixels,
+            graphic->img.width, graphic->img.height,
+            32,
+            graphic->img.width * 4,
+            SDL_PIXELFORMAT_RGBA32);
     }
-    struct GIF_Graphic const *const graphic = (*start)->data;
-    struct SurfaceGraphic *g = surfacegraphic_from_graphic(
-        graphic, gif->global_color_table);
-    linkedlist_append(&surfacegraphics, linkedlist_new(g));
-
-    /* Create the current frame, copying over data from the previous frame. */
-    SDL_Surface *frame = SDL_CreateRGBSurfaceWithFormat(
-        0, (*nextframe)->w, (*nextframe)->h, 32, SDL_PIXELFORMAT_RGBA32);
-    SDL_BlitSurface(*nextframe, NULL, frame, NULL);
-
-    LinkedList const *gcurr = start_orig;
-    LinkedList *sgcurr = surfacegraphics;
-    for (; sgcurr != NULL; gcurr = gcurr->next)
+    else
+    {
+        /* Create the current frame, copying over data from the previous
+         * frame. */
+        frame = SDL_CreateRGBSurfaceWithFormat(
+            0, (*nextframe)->w, (*nextframe)->h, 32, SDL_PIXELFORMAT_RGBA32);
+        SDL_BlitSurface(*nextframe, NULL, frame, NULL);
+    }
+
+    for (size_t i = 0; i < count; ++i)
     {
-        struct GIF_Graphic const *const g = gcurr->data;
-        struct SurfaceGraphic *const sg = sgcurr->data;
+        struct GIF_Graphic const *const g = &graphics[i];
+        struct SurfaceGraphic *const sg = surfacegraphics[i];
 
         struct GIF_GraphicExt const *const extension = g->extension;
 
+        bool const indexed = graphic_is_indexed(g);
+
         /* Apply the graphic to the next frame according to its disposal
          * method. */
         enum DisposalMethod const dm =\
@@ -280,67 +483,344 @@ _make_frame(
                 SDL_MapRGBA((*nextframe)->format, bg[0], bg[1], bg[2], bg[3]));
             break;
         default:
-            SDL_BlitSurface(sg->surface, NULL, *nextframe, &sg->rect);
+            /* Indexed images are drawn onto both frames together below. */
+            if (!indexed)
+                SDL_BlitSurface(sg->surface, NULL, *nextframe, &sg->rect);
             break;
         }
 
-        SDL_BlitSurface(sg->surface, NULL, frame, &sg->rect);
+        if (indexed)
+        {
+            bool const to_next = (
+                dm != GIF_DisposalMethod_RestorePrevious
+                && dm != GIF_DisposalMethod_RestoreBackground);
+            draw_indexed_image(
+                frame, to_next? *nextframe : NULL, &g->img, extension,
+                g->img.color_table->rgba);
+        }
+        else if (!direct)
+            SDL_BlitSurface(sg->surface, NULL, frame, &sg->rect);
 
-        /* Free the list behind us. */
-        LinkedList *old = sgcurr;
-        sgcurr = sgcurr->next;
-        surfacegraphic_free(old->data);
-        free(old);
+        /* Free the graphics behind us. */
+        surfacegraphic_free(sg);
     }
+    free(surfacegraphics);
+    _free_frame_graphics(gif, start_orig, count, graphics);
 
     return frame;
 }
 
-GraphicList graphiclist_new_from_gif(SDL_Renderer *renderer, GIF gif)
+
+/* ===[ Frame Cache ]=== */
+/** Size of frame INDEX of LIST, in bytes. */
+size_t _frame_bytes(GraphicList const *list, size_t index)
+{
+    struct SDLGraphic const *const frame = &list->frames[index];
+    return (size_t)frame->width * frame->height * 4;
+}
+
+/** Take the cached frame INDEX out of LIST's list of cached frames. */
+void _cache_unlink(GraphicList *list, size_t index)
+{
+    struct SDLGraphic *const frame = &list->frames[index];
+    if (frame->newer != GRAPHICLIST_NONE)
+        list->frames[frame->newer].older = frame->older;
+    else
+        list->newest = frame->older;
+    if (frame->older != GRAPHICLIST_NONE)
+        list->frames[frame->older].newer = frame->newer;
+    else
+        list->oldest = frame->newer;
+    frame->newer = frame->older = GRAPHICLIST_NONE;
+}
+
+/** Put the cached frame INDEX at the newest end of LIST's cached frames. */
+void _cache_push_newest(GraphicList *list, size_t index)
 {
-    SDL_Surface *lastframe = SDL_CreateRGBSurfaceWithFormat(
-        0, gif.width, gif.height, 32, SDL_PIXELFORMAT_RGBA32);
-    SDL_FillRect(lastframe, NULL, SDL_MapRGBA(lastframe->format, 0, 0, 0, 0));
+    struct SDLGraphic *const frame = &list->frames[index];
+    frame->newer = GRAPHICLIST_NONE;
+    frame->older = list->newest;
+    if (list->newest != GRAPHICLIST_NONE)
+        list->frames[list->newest].newer = index;
+    else
+        list->oldest = index;
+    list->newest = index;
+}
 
-    GraphicList out = NULL;
-    for (LinkedList const *node = gif.graphics; node; node = node->next)
+/** Drop the least recently used frames from LIST until BYTES more fit. */
+void _cache_make_room(GraphicList *list, size_t bytes)
+{
+    while (list->oldest != GRAPHICLIST_NONE
+        && list->cache_bytes + bytes > list->cache_limit)
     {
-        SDL_Surface *frame = _make_frame(&node, &lastframe, &gif);
+        size_t const index = list->oldest;
+        _cache_unlink(list, index);
+        graphic_free(&list->frames[index]);
+        list->frames[index].texture = NULL;
+        list->cache_bytes -= _frame_bytes(list, index);
+    }
+}
 
-        struct GIF_Graphic *g = node->data;
-        struct SDLGraphic *frame_g = graphic_new();
-        frame_g->delay = g->extension? g->extension->delay_time : 0;
-        frame_g->width = frame->w;
-        frame_g->height = frame->h;
-        frame_g->texture = SDL_CreateTextureFromSurface(renderer, frame);
+/** Start LIST's basis over, from before the first frame. */
+void _reset_basis(GraphicList *list)
+{
+    SDL_FillRect(
+        list->basis, NULL, SDL_MapRGBA(list->basis->format, 0, 0, 0, 0));
+    list->basis_frame = 0;
+}
 
-        SDL_FreeSurface(frame);
+/** Copy the pixels of the same-sized RGBA surface FROM into TO. */
+void _copy_surface(SDL_Surface *restrict to, SDL_Surface const *restrict from)
+{
+    size_t const row_bytes = (size_t)from->w * 4;
+    for (int y = 0; y < from->h; ++y)
+    {
+        memcpy(
+            (uint8_t *)to->pixels + (size_t)y * to->pitch,
+            (uint8_t const *)from->pixels + (size_t)y * from->pitch,
+            row_bytes);
+    }
+}
+
+/**
+ * Choose how often LIST snapshots its basis, so that a snapshot every
+ * SNAPSHOT_INTERVAL frames or more fits in a quarter of its cache.
+ */
+void _init_snapshots(GraphicList *list)
+{
+    size_t const bytes = (size_t)list->basis->w * list->basis->h * 4;
+    size_t const room = bytes? list->cache_limit / 4 / bytes : 0;
+    if (room == 0 || list->count <= SNAPSHOT_INTERVAL)
+        return;
+    size_t interval = (list->count + room - 1) / room;
+    if (interval < SNAPSHOT_INTERVAL)
+        interval = SNAPSHOT_INTERVAL;
+    list->snapshot_interval = interval;
+    list->snapshots = calloc(
+        (list->count - 1) / interval + 1, sizeof(*list->snapshots));
+    if (list->snapshots == NULL)
+        fatal("calloc: %s\n", strerror(errno));
+}
 
-        linkedlist_append(&out, linkedlist_new(frame_g));
+/** Keep a copy of LIST's basis, if its frame is due a snapshot. */
+void _snapshot_basis(GraphicList *list)
+{
+    size_t const frame = list->basis_frame;
+    if (list->snapshots == NULL || frame == 0
+        || frame % list->snapshot_interval != 0
+        || list->snapshots[frame / list->snapshot_interval] != NULL)
+    {
+        return;
     }
+    SDL_Surface *const snapshot = SDL_CreateRGBSurfaceWithFormat(
+        0, list->basis->w, list->basis->h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (snapshot == NULL)
+    {
+        error("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+        return;
+    }
+    _copy_surface(snapshot, list->basis);
+    list->snapshots[frame / list->snapshot_interval] = snapshot;
+    list->cache_bytes += (size_t)snapshot->w * snapshot->h * 4;
+}
 
-    /* Make the list circular, for free looping. */
-    for (GraphicList g = out; g != NULL; g = g->next)
+/**
+ * Get LIST's basis ready to draw up to frame INDEX, moving it to the latest
+ * snapshot before INDEX if that's closer than where it is, or starting over
+ * if it's past INDEX and there's no snapshot to go back to.
+ */
+void _seek_basis(GraphicList *list, size_t index)
+{
+    size_t snapshot = 0;
+    if (list->snapshots != NULL)
+    {
+        snapshot = index / list->snapshot_interval;
+        while (snapshot != 0 && list->snapshots[snapshot] == NULL)
+            --snapshot;
+    }
+    size_t const frame = snapshot * list->snapshot_interval;
+    if (list->basis_frame <= index && list->basis_frame >= frame)
+        return;
+    if (snapshot == 0)
+        _reset_basis(list);
+    else
     {
-        if (g->next == NULL)
+        _copy_surface(list->basis, list->snapshots[snapshot]);
+        list->basis_frame = frame;
+    }
+}
+
+SDL_Texture *graphiclist_get_texture(GraphicList *graphics, size_t index)
+{
+    struct SDLGraphic *const frame = &graphics->frames[index];
+    if (graphics->cache_limit == 0)
+    {
+        /* The texture mirrors the store's canvas, so only what the store
+         * rewrote getting to this frame needs uploading. */
+        SDL_Rect changed;
+        framestore_seek(&graphics->store, index, &changed);
+        if (!SDL_RectEmpty(&changed))
         {
-            g->next = out;
-            break;
+            struct FrameStore const *const store = &graphics->store;
+            SDL_UpdateTexture(
+                graphics->texture, &changed,
+                store->canvas + (size_t)changed.y * store->width + changed.x,
+                store->width * sizeof(*store->canvas));
+        }
+        return graphics->texture;
+    }
+    if (frame->texture != NULL)
+    {
+        _cache_unlink(graphics, index);
+        _cache_push_newest(graphics, index);
+        return frame->texture;
+    }
+
+    /* Every frame from the basis up to this one has to be drawn to get to
+     * it.  Going backwards means starting again from a snapshot. */
+    _seek_basis(graphics, index);
+    SDL_Surface *surface = NULL;
+    for (; graphics->basis_frame <= index; ++graphics->basis_frame)
+    {
+        _snapshot_basis(graphics);
+        size_t start = graphics->frames[graphics->basis_frame].first;
+        SDL_FreeSurface(surface);
+        surface = _make_frame(&start, &graphics->basis, graphics->gif);
+    }
+
+    size_t const bytes = _frame_bytes(graphics, index);
+    _cache_make_room(graphics, bytes);
+    frame->texture = SDL_CreateTextureFromSurface(graphics->renderer, surface);
+    SDL_FreeSurface(surface);
+    if (frame->texture == NULL)
+    {
+        error("SDL_CreateTextureFromSurface -- %s\n", SDL_GetError());
+        return NULL;
+    }
+    graphics->cache_bytes += bytes;
+    _cache_push_newest(graphics, index);
+    return frame->texture;
+}
+
+GraphicList graphiclist_new_from_gif(
+    SDL_Renderer *renderer, GIF const *gif,
+    struct GraphicList_Options const *options)
+{
+    size_t const cache_limit = options->cache_limit;
+    GraphicList out = {
+        .frames = NULL,
+        .count = 0,
+        .renderer = renderer,
+        .store = {0},
+        .texture = NULL,
+        .gif = gif,
+        .cache_limit = cache_limit,
+        .cache_bytes = 0,
+        .newest = GRAPHICLIST_NONE,
+        .oldest = GRAPHICLIST_NONE,
+        .basis = NULL,
+        .basis_frame = 0,
+        .snapshots = NULL,
+        .snapshot_interval = 0,
+    };
+    out.basis = SDL_CreateRGBSurfaceWithFormat(
+        0, gif->width, gif->height, 32, SDL_PIXELFORMAT_RGBA32);
+    _reset_basis(&out);
+    if (cache_limit == 0)
+    {
+        out.store = framestore_new(
+            gif->width, gif->height, KEYFRAME_INTERVAL, options->lossy);
+    }
+
+    /* There can't be more frames than graphics. */
+    out.frames = malloc(gif->graphic_count * sizeof(*out.frames));
+    if (out.frames == NULL && gif->graphic_count != 0)
+        fatal("malloc: %s\n", strerror(errno));
+    for (size_t i = 0; i < gif->graphic_count; ++i)
+    {
+        struct SDLGraphic *frame_g = &out.frames[out.count++];
+        frame_g->first = i;
+        frame_g->newer = frame_g->older = GRAPHICLIST_NONE;
+        bool merged = false;
+        if (cache_limit != 0)
+        {
+            /* Made later, by graphiclist_get_texture. */
+            i = _frame_last_graphic(gif, i);
+            frame_g->texture = NULL;
+            frame_g->width = gif->width;
+            frame_g->height = gif->height;
         }
+        else
+        {
+            SDL_Surface *frame = _make_frame(&i, &out.basis, gif);
+            merged = options->merge && framestore_is_unchanged(
+                &out.store, frame->pixels, frame->pitch);
+            if (merged)
+            {
+                /* Show the frame before for longer instead. */
+                out.count--;
+                frame_g = &out.frames[out.count - 1];
+            }
+            else
+            {
+                framestore_push(
+                    &out.store, frame->pixels, frame->pitch,
+                    _frame_covers_canvas(gif, frame_g->first, i));
+                frame_g->texture = NULL;
+                frame_g->width = frame->w;
+                frame_g->height = frame->h;
+            }
+            SDL_FreeSurface(frame);
+        }
+        frame_g->last = i;
+
+        struct GIF_Graphic const *g = &gif->graphics[i];
+        size_t const delay = g->extension? g->extension->delay_time : 0;
+        frame_g->delay = merged? frame_g->delay + delay : delay;
     }
 
+    if (cache_limit == 0)
+    {
+        if (options->compress)
+            framestore_compress(&out.store, DECOMPRESS_AHEAD);
+        out.texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+            gif->width, gif->height);
+        if (out.texture == NULL)
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+        else
+            SDL_SetTextureBlendMode(out.texture, SDL_BLENDMODE_BLEND);
+        if (out.texture != NULL && out.count != 0)
+        {
+            /* Start the texture off as the store redraws frames, rather than
+             * as the last one was given to the store. */
+            SDL_Rect changed;
+            framestore_seek(&out.store, 0, &changed);
+            SDL_UpdateTexture(
+                out.texture, NULL, out.store.canvas,
+                out.store.width * sizeof(*out.store.canvas));
+        }
+    }
+    else
+        _init_snapshots(&out);
     return out;
 }
 
 void graphiclist_free(GraphicList graphics)
 {
-    for (GraphicList node = graphics->next; node != NULL;)
+    for (size_t i = 0; i < graphics.count; ++i)
+        graphic_free(&graphics.frames[i]);
+    free(graphics.frames);
+    framestore_free(graphics.store);
+    if (graphics.texture)
+        SDL_DestroyTexture(graphics.texture);
+    SDL_FreeSurface(graphics.basis);
+    if (graphics.snapshots != NULL)
     {
-        graphic_free(node->data);
-        GraphicList next = node->next;
-        free(node);
-        if (node == graphics)
-            break;
-        node = next;
+        size_t const count = (
+            (graphics.count - 1) / graphics.snapshot_interval + 1);
+        for (size_t i = 0; i < count; ++i)
+            SDL_FreeSurface(graphics.snapshots[i]);
+        free(graphics.snapshots);
     }
 }
@@ -20,29 +20,100 @@
 #ifndef GIFVIEW_SDLGIF_H
 #define GIFVIEW_SDLGIF_H
 
+#include "framestore.h"
 #include "util.h"
 #include "gif/gif.h"
 
+#include <stdint.h>
+
 #include <SDL2/SDL.h>
 
 
-/** SDL data for a GIF graphic.  Represents a complete frame of a GIF. */
+/**
+ * SDL data for a GIF graphic.  Represents a complete frame of a GIF, made of
+ * the GIF's graphics FIRST through LAST.  TEXTURE is only used by lazy
+ * GraphicLists, where it's NULL unless the frame is cached, in which case
+ * NEWER and OLDER link it into the cache's list.
+ */
 struct SDLGraphic
 {
     SDL_Texture *texture;
     int width, height;
     size_t delay;
+    size_t first, last;
+    size_t newer, older;
 };
 
+/** End of the list of cached frames. */
+#define GRAPHICLIST_NONE    SIZE_MAX
+
+
+/**
+ * The COUNT frames of a GIF, in order.
+ *
+ * If CACHE_LIMIT is 0, every frame was made up front and kept in STORE, and
+ * TEXTURE shows whichever of them was last asked for.  Otherwise the list is
+ * lazy: frames are made from GIF's graphics when they're asked for, and up
+ * to CACHE_LIMIT bytes of them are kept, in a list from NEWEST to OLDEST use
+ * taking up CACHE_BYTES.  Frames are drawn on top of the ones before them, so
+ * BASIS is what frame BASIS_FRAME will be drawn on top of.  To go back
+ * without starting again from the first frame, SNAPSHOTS holds copies of the
+ * basis of every SNAPSHOT_INTERVAL'th frame drawn so far, NULL where there
+ * isn't one yet, or is NULL itself if there's no room for any.  They count
+ * towards CACHE_BYTES, but are never dropped.
+ */
+typedef struct GraphicList
+{
+    struct SDLGraphic *frames;
+    size_t count;
+
+    SDL_Renderer *renderer;
+    struct FrameStore store;
+    SDL_Texture *texture;
 
-/** LinkedList<SDLGraphic>. */
-typedef LinkedList *GraphicList;
+    GIF const *gif;
+    size_t cache_limit, cache_bytes;
+    size_t newest, oldest;
+    SDL_Surface *basis;
+    size_t basis_frame;
+    SDL_Surface **snapshots;
+    size_t snapshot_interval;
+} GraphicList;
 
 
-/** Generate a linked list of Graphics from a linked list of GIF_Graphics. */
-GraphicList graphiclist_new_from_gif(SDL_Renderer *renderer, GIF gif);
+/**
+ * How graphiclist_new_from_gif makes frames.  If CACHE_LIMIT is 0, they're
+ * all made up front, and stored as compactly as they can be, with identical
+ * frames sharing storage.  Then, if LOSSY is true, opaque frames may lose
+ * some color precision for it; if COMPRESS is true, frames not near the one
+ * being shown are kept compressed; and if MERGE is true, a run of identical
+ * frames becomes one frame, shown for all their delays.  Otherwise frames are
+ * made as they're needed, keeping at most CACHE_LIMIT bytes of them.
+ */
+struct GraphicList_Options
+{
+    size_t cache_limit;
+    bool lossy;
+    bool compress;
+    bool merge;
+};
+
+
+/**
+ * Generate the frames of a GIF from its GIF_Graphics, as OPTIONS says.  If
+ * they're made as they're needed, GIF must outlive the list.
+ */
+GraphicList graphiclist_new_from_gif(
+    SDL_Renderer *renderer, GIF const *gif,
+    struct GraphicList_Options const *options);
+
+/**
+ * Get the texture of frame INDEX of GRAPHICS, making it if need be.  Returns
+ * NULL if it couldn't be made.
+ */
+SDL_Texture *graphiclist_get_texture(GraphicList *graphics, size_t index);
 
-/** Free a linked list of Graphics. */
+/** Free a list of frames. */
 void graphiclist_free(GraphicList graphics);
 
 
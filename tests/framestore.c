@@ -0,0 +1,195 @@
+/*
+ * framestore.c -- Tests that stored frames come back as they went in.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "framestore.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/** Size of the test frames, odd so rows don't line up with anything. */
+#define WIDTH       23
+#define HEIGHT      17
+#define PIXELS      (WIDTH * HEIGHT)
+/** Number of test frames. */
+#define FRAMES      72
+
+
+/** Pack R, G, B and A into a pixel, in memory order. */
+uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    uint8_t const bytes[4] = {r, g, b, a};
+    uint32_t pixel;
+    memcpy(&pixel, bytes, sizeof(pixel));
+    return pixel;
+}
+
+/**
+ * Make the test frames in FRAMES.  Each changes a random rectangle of the one
+ * before it, with a few colors at first, then with too many for a palette,
+ * then with transparency, so the store has to change format twice.  Along
+ * the way, some frames repeat the one before them, and some repeat earlier
+ * ones, including ones from before a change of format.
+ */
+void make_frames(uint32_t frames[FRAMES][PIXELS])
+{
+    uint32_t state = 1;
+    uint32_t palette[8];
+    for (size_t i = 0; i < 8; ++i)
+    {
+        uint32_t const r = test_random(&state);
+        palette[i] = rgba(r, r >> 8, r >> 16, 0xFF);
+    }
+    for (size_t f = 0; f < FRAMES; ++f)
+    {
+        uint32_t *const frame = frames[f];
+        if (f == 0)
+        {
+            for (size_t i = 0; i < PIXELS; ++i)
+                frame[i] = palette[i % 3];
+            continue;
+        }
+        memcpy(frame, frames[f - 1], sizeof(*frames));
+        if (f % 11 == 10)
+            continue;
+        if (f % 7 == 6 || f == 50 || f == 65)
+        {
+            size_t const earlier = f < 50? f - 5 : f - 47;
+            memcpy(frame, frames[earlier], sizeof(*frames));
+            continue;
+        }
+
+        size_t const x = test_random(&state) % WIDTH;
+        size_t const y = test_random(&state) % HEIGHT;
+        size_t const w = test_random(&state) % (WIDTH - x) + 1;
+        size_t const h = test_random(&state) % (HEIGHT - y) + 1;
+        for (size_t row = y; row < y + h; ++row)
+        {
+            for (size_t col = x; col < x + w; ++col)
+            {
+                uint32_t const r = test_random(&state);
+                uint32_t pixel = palette[r % 8];
+                if (f >= FRAMES / 3)
+                    pixel = rgba(r, r >> 8, r >> 16, 0xFF);
+                if (f >= 2 * FRAMES / 3 && r >> 29 == 0)
+                    pixel = rgba(r, r >> 8, r >> 16, 0);
+                frame[row * WIDTH + col] = pixel;
+            }
+        }
+    }
+}
+
+/**
+ * Seek STORE to frame INDEX, checking that its canvas holds the frame it was
+ * given, and that nothing outside the rectangle said to have changed did.
+ */
+void check_seek(
+    struct FrameStore *store, uint32_t frames[FRAMES][PIXELS], size_t index,
+    char const *name)
+{
+    static uint32_t before[PIXELS];
+    memcpy(before, store->canvas, sizeof(before));
+    SDL_Rect changed;
+    framestore_seek(store, index, &changed);
+    CHECK(
+        memcmp(store->canvas, frames[index], sizeof(before)) == 0,
+        "%s: frame %zu is wrong", name, index);
+    for (int y = 0; y < HEIGHT; ++y)
+    {
+        for (int x = 0; x < WIDTH; ++x)
+        {
+            size_t const i = (size_t)y * WIDTH + x;
+            bool const inside = (
+                x >= changed.x && x < changed.x + changed.w
+                && y >= changed.y && y < changed.y + changed.h);
+            CHECK(
+                store->canvas[i] == before[i] || inside,
+                "%s: seeking to frame %zu changed (%d, %d) outside the "
+                "changed rectangle", name, index, x, y);
+        }
+    }
+}
+
+/** Seek through every frame of STORE forwards, backwards, and at random. */
+void check_seeks(
+    struct FrameStore *store, uint32_t frames[FRAMES][PIXELS],
+    char const *name)
+{
+    for (size_t i = 0; i < FRAMES; ++i)
+        check_seek(store, frames, i, name);
+    for (size_t i = FRAMES; i-- > 0;)
+        check_seek(store, frames, i, name);
+    uint32_t state = 2;
+    for (size_t i = 0; i < 4 * FRAMES; ++i)
+        check_seek(store, frames, test_random(&state) % FRAMES, name);
+    /* Every frame from every other, which covers going to and from each
+     * copy. */
+    SDL_Rect ignored;
+    for (size_t from = 0; from < FRAMES; ++from)
+    {
+        for (size_t to = 0; to < FRAMES; ++to)
+        {
+            framestore_seek(store, from, &ignored);
+            check_seek(store, frames, to, name);
+        }
+    }
+}
+
+
+int main(void)
+{
+    static uint32_t frames[FRAMES][PIXELS];
+    make_frames(frames);
+
+    static size_t const intervals[] = {1, 4, 16, FRAMES};
+    for (size_t i = 0; i < sizeof(intervals) / sizeof(*intervals); ++i)
+    {
+        char name[64];
+        struct FrameStore store = framestore_new(
+            WIDTH, HEIGHT, intervals[i], false);
+        size_t formats_seen = 1;
+        for (size_t f = 0; f < FRAMES; ++f)
+        {
+            enum FrameStore_Format const format = store.format;
+            framestore_push(
+                &store, frames[f], WIDTH * sizeof(**frames), false);
+            formats_seen += store.format != format;
+        }
+        size_t copies = 0;
+        for (size_t f = 0; f < FRAMES; ++f)
+            copies += store.frames[f].copy != FRAMESTORE_NONE;
+        CHECK(
+            formats_seen == 3 && store.format == FrameStore_Format_RGBA32,
+            "interval %zu: went through %zu formats, ending with %s",
+            intervals[i], formats_seen,
+            framestore_format_name(store.format));
+        CHECK(copies != 0, "interval %zu: no frames were copies", intervals[i]);
+
+        snprintf(name, sizeof(name), "interval %zu", intervals[i]);
+        check_seeks(&store, frames, name);
+        framestore_compress(&store, 3);
+        snprintf(name, sizeof(name), "interval %zu, compressed", intervals[i]);
+        check_seeks(&store, frames, name);
+        framestore_free(store);
+    }
+    return TEST_RESULT();
+}
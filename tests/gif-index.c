@@ -0,0 +1,148 @@
+/*
+ * gif-index.c -- Tests that the index scan reads GIFs as the loader does.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "gif/gif.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/** Add the bytes of the string literal S to the GIF being built. */
+#define ADD(s)  add(s, sizeof(s) - 1)
+
+/** Header, Logical Screen Descriptor and 2 color table of a 2x2 GIF. */
+#define HEAD    "GIF89a\x02\x00\x02\x00\x80\x00\x00\x00\x00\x00\xff\xff\xff"
+/** A 2x2 image, all of color 0. */
+#define IMAGE   "\x2c\x00\x00\x00\x00\x02\x00\x02\x00\x00\x02\x02\x4c\x01\x00"
+/** A Graphic Control Extension with a delay of 10. */
+#define GCE     "\x21\xf9\x04\x04\x0a\x00\x00\x00"
+/** A Plain Text Extension covering the whole canvas. */
+#define TEXT    \
+    "\x21\x01\x0c\x00\x00\x00\x00\x02\x00\x02\x00\x01\x01\x01\x00" \
+    "\x02hi\x00"
+/** A NETSCAPE2.0 Application Extension, looping 5 times. */
+#define LOOP    "\x21\xff\x0bNETSCAPE2.0\x03\x01\x05\x00\x00"
+#define COMMENT "\x21\xfe\x05hello\x00"
+#define TRAILER "\x3b"
+
+
+/** The GIF being built. */
+static uint8_t gif_data[1024];
+static size_t gif_size;
+
+/** Add the SIZE bytes at BYTES to the GIF being built. */
+void add(char const *bytes, size_t size)
+{
+    memcpy(gif_data + gif_size, bytes, size);
+    gif_size += size;
+}
+
+/**
+ * Check that scanning the first SIZE bytes of the GIF that's been built
+ * finds what loading it does.
+ */
+void check_agreement(char const *gif_name, size_t size)
+{
+    char name[128];
+    snprintf(name, sizeof(name), "%s, %zu bytes", gif_name, size);
+    struct GIF_Index index;
+    bool const complete = gif_index_scan(gif_data, size, &index);
+    struct GIF_LoadOptions const options = {.lazy = true};
+    GIF gif;
+    enum GIF_Status const status = gif_from_memory(
+        gif_data, size, &options, &gif);
+
+    CHECK(
+        complete == (status == GIF_Status_OK),
+        "%s: scan complete is %d, but loading gave \"%s\"", name, complete,
+        gif_status_message(status));
+    CHECK(
+        index.count == gif.graphic_count,
+        "%s: scan found %zu graphics, not %zu", name, index.count,
+        gif.graphic_count);
+    CHECK(
+        index.app_extension_count == gif.app_extension_count,
+        "%s: scan found %zu application extensions, not %zu", name,
+        index.app_extension_count, gif.app_extension_count);
+    CHECK(
+        index.comment_count == gif.comment_count,
+        "%s: scan found %zu comments, not %zu", name, index.comment_count,
+        gif.comment_count);
+    for (size_t i = 0; i < index.count && i < gif.graphic_count; ++i)
+    {
+        struct GIF_IndexEntry const *const entry = &index.entries[i];
+        struct GIF_Graphic const *const graphic = &gif.graphics[i];
+        CHECK(
+            entry->is_img == graphic->is_img,
+            "%s: graphic %zu is_img is %d, not %d", name, i, entry->is_img,
+            graphic->is_img);
+        CHECK(
+            entry->has_extension == (graphic->extension != NULL),
+            "%s: graphic %zu has_extension is %d", name, i,
+            entry->has_extension);
+        if (entry->has_extension && graphic->extension != NULL)
+        {
+            CHECK(
+                entry->extension.delay_time == graphic->extension->delay_time,
+                "%s: graphic %zu delay is %u, not %u", name, i,
+                entry->extension.delay_time, graphic->extension->delay_time);
+        }
+    }
+    gif_index_free(&index);
+    gif_free(gif);
+}
+
+/** Check a GIF made of HEAD, BODY and TRAILER, cut short anywhere. */
+#define CHECK_BODY(name, body) \
+    do \
+    { \
+        gif_size = 0; \
+        ADD(HEAD body TRAILER); \
+        for (size_t size = 0; size <= gif_size; ++size) \
+            check_agreement(name, size); \
+    } while (0)
+
+
+int main(void)
+{
+    CHECK_BODY("well formed", LOOP COMMENT GCE IMAGE GCE TEXT IMAGE);
+    CHECK_BODY("no graphics", COMMENT);
+    /* Extensions too short to hold their fields are skipped by both, but
+     * don't stop the rest of the GIF being read. */
+    CHECK_BODY("empty GCE", "\x21\xf9\x00" IMAGE);
+    CHECK_BODY("short GCE", "\x21\xf9\x03\x04\x05\x00\x00" IMAGE);
+    CHECK_BODY("short plain text", "\x21\x01\x05" "abcde\x00" IMAGE);
+    CHECK_BODY("short application extension", "\x21\xff\x03" "abc\x00" IMAGE);
+    /* Fields split across sub-blocks. */
+    CHECK_BODY("split GCE", "\x21\xf9\x02\x04\x0a\x02\x00\x00\x00" IMAGE);
+    CHECK_BODY(
+        "split loop", "\x21\xff\x0bNETSCAPE2.0\x02\x01\x05\x01\x00\x00" IMAGE);
+    CHECK_BODY("unknown extension", "\x21\x42\x02" "ab\x00" GCE IMAGE);
+    CHECK_BODY("GCE before the trailer", IMAGE GCE);
+    CHECK_BODY("unknown block", IMAGE "\x99" IMAGE);
+    CHECK_BODY(
+        "local color table",
+        GCE "\x2c\x00\x00\x00\x00\x02\x00\x02\x00\x81"
+        "\x00\x00\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99"
+        "\x02\x02\x4c\x01\x00");
+    return TEST_RESULT();
+}
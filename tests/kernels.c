@@ -0,0 +1,133 @@
+/*
+ * kernels.c -- Tests for the SIMD pixel kernels.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "kernels/kernels.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+/** Most pixels passed to a kernel at once. */
+#define MAX_PIXELS  1000
+/** Random calls made to each kernel. */
+#define ROUNDS      2000
+
+
+/**
+ * Check that the kernels for CPU give the same pixels as the SCALAR ones, on
+ * random input of random lengths and alignments.
+ */
+void check_kernels(struct Kernels const *scalar, enum Kernels_CPU cpu)
+{
+    static uint8_t in[MAX_PIXELS + 64];
+    static uint32_t expected[MAX_PIXELS + 16], expected2[MAX_PIXELS + 16];
+    static uint32_t out[MAX_PIXELS + 16], out2[MAX_PIXELS + 16];
+    static size_t const color_counts[] = {2, 16, 17, 256};
+    char const *const name = kernels_cpu_name(cpu);
+    uint32_t state = 1;
+    uint32_t palette[256];
+
+    for (size_t round = 0; round < ROUNDS; ++round)
+    {
+        size_t const colors = color_counts[round % 4];
+        size_t const n = test_random(&state) % (MAX_PIXELS + 1);
+        size_t const in_offset = test_random(&state) % 64;
+        size_t const out_offset = test_random(&state) % 16;
+        for (size_t i = 0; i < 256; ++i)
+            palette[i] = test_random(&state);
+        for (size_t i = 0; i < n; ++i)
+            in[in_offset + i] = test_random(&state) % colors;
+        uint8_t const key = test_random(&state) % colors;
+        for (size_t i = 0; i < MAX_PIXELS + 16; ++i)
+            expected[i] = expected2[i] = test_random(&state);
+
+        uint8_t const *const source = in + in_offset;
+        memcpy(out, expected, sizeof(out));
+        scalar->expand(expected + out_offset, source, n, palette);
+        kernels->expand(out + out_offset, source, n, palette);
+        CHECK(
+            memcmp(out, expected, sizeof(out)) == 0,
+            "%s expand differs, %zu pixels of %zu colors", name, n, colors);
+
+        memcpy(out, expected, sizeof(out));
+        memcpy(out2, expected2, sizeof(out2));
+        scalar->blit_keyed(
+            expected + out_offset, expected2 + out_offset, source, n,
+            palette, key);
+        kernels->blit_keyed(
+            out + out_offset, out2 + out_offset, source, n, palette, key);
+        CHECK(
+            memcmp(out, expected, sizeof(out)) == 0
+                && memcmp(out2, expected2, sizeof(out2)) == 0,
+            "%s blit_keyed differs, %zu pixels of %zu colors", name, n,
+            colors);
+
+        memcpy(out, expected, sizeof(out));
+        scalar->blit_keyed(
+            expected + out_offset, NULL, source, n, palette, key);
+        kernels->blit_keyed(
+            out + out_offset, NULL, source, n, palette, key);
+        CHECK(
+            memcmp(out, expected, sizeof(out)) == 0,
+            "%s blit_keyed without a second output differs, %zu pixels of "
+            "%zu colors", name, n, colors);
+    }
+}
+
+
+int main(void)
+{
+    kernels_init(Kernels_CPU_Scalar);
+    struct Kernels const *const scalar = kernels;
+
+    /* The scalar kernels are what the others are held to, so they get
+     * checked by hand. */
+    uint32_t palette[256];
+    for (size_t i = 0; i < 256; ++i)
+        palette[i] = 0x01010101 * i;
+    uint8_t const in[5] = {3, 0, 255, 7, 3};
+    uint32_t out[5] = {0}, out2[5] = {0};
+    scalar->expand(out, in, 5, palette);
+    for (size_t i = 0; i < 5; ++i)
+        CHECK(out[i] == palette[in[i]], "scalar expand is wrong at %zu", i);
+    memset(out, 0xEE, sizeof(out));
+    scalar->blit_keyed(out, out2, in, 5, palette, 3);
+    for (size_t i = 0; i < 5; ++i)
+    {
+        uint32_t const want = in[i] == 3? 0xEEEEEEEE : palette[in[i]];
+        CHECK(out[i] == want, "scalar blit_keyed is wrong at %zu", i);
+        CHECK(
+            out2[i] == (in[i] == 3? 0 : palette[in[i]]),
+            "scalar blit_keyed's second output is wrong at %zu", i);
+    }
+
+    enum Kernels_CPU const best = kernels_detect();
+    for (int cpu = Kernels_CPU_SSE2; cpu <= best; ++cpu)
+    {
+        CHECK(
+            kernels_init(cpu) == (enum Kernels_CPU)cpu,
+            "%s kernels weren't chosen", kernels_cpu_name(cpu));
+        check_kernels(scalar, cpu);
+    }
+    if (best == Kernels_CPU_Scalar)
+        puts("no SIMD kernels to check on this CPU");
+    return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+/*
+ * lz.c -- Tests for the in-memory frame compressor.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+
+/** Kinds of data to compress. */
+enum Fill
+{
+    Fill_Zeros,
+    Fill_Random,
+    /** A short pattern over and over, as flat or dithered pixels give. */
+    Fill_Pattern,
+    /** Runs of flat bytes, random bytes, and repeats of earlier runs. */
+    Fill_Mixed,
+};
+
+static char const *const FILL_NAMES[] = {"zeros", "random", "pattern", "mixed"};
+
+
+/** Fill the SIZE bytes at OUT with data of kind FILL. */
+void fill(uint8_t *out, size_t size, enum Fill fill)
+{
+    uint32_t state = size + 1;
+    for (size_t i = 0; i < size;)
+    {
+        uint32_t const r = test_random(&state);
+        switch (fill)
+        {
+        case Fill_Zeros:
+            out[i++] = 0;
+            break;
+        case Fill_Random:
+            out[i++] = r;
+            break;
+        case Fill_Pattern:
+            out[i] = "\x12\x34\x56\x78\x9a"[i % 5];
+            i++;
+            break;
+        case Fill_Mixed:
+        {
+            size_t run = r % 300 + 1;
+            if (run > size - i)
+                run = size - i;
+            /* Repeats come from nearby, or from too far back to match. */
+            size_t const back = (r >> 30) == 2? 1000 : 70000;
+            for (size_t j = i; j < i + run; ++j)
+            {
+                if (r >> 30 == 0 || j < back)
+                    out[j] = r >> 16;
+                else if (r >> 30 == 1)
+                    out[j] = test_random(&state);
+                else
+                    out[j] = out[j - back];
+            }
+            i += run;
+            break;
+        }
+        }
+    }
+}
+
+/** Check that SIZE bytes of kind FILL come back as they went in. */
+void check_round_trip(size_t size, enum Fill kind)
+{
+    uint8_t *const in = malloc(size? size : 1);
+    uint8_t *const packed = malloc(lz_bound(size));
+    uint8_t *const out = malloc(size + 1);
+    if (in == NULL || packed == NULL || out == NULL)
+    {
+        fputs("out of memory\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    fill(in, size, kind);
+    char const *const name = FILL_NAMES[kind];
+
+    size_t const packed_size = lz_compress(in, size, packed);
+    CHECK(
+        packed_size <= lz_bound(size), "%zu bytes of %s: %zu is over %zu",
+        size, name, packed_size, lz_bound(size));
+    CHECK(
+        lz_decompress(packed, packed_size, out, size)
+            && memcmp(in, out, size) == 0,
+        "%zu bytes of %s don't round trip", size, name);
+
+    /* Any size but the right one is an error, as is running out. */
+    CHECK(
+        !lz_decompress(packed, packed_size, out, size + 1),
+        "%zu bytes of %s decompress into %zu", size, name, size + 1);
+    if (size != 0)
+    {
+        CHECK(
+            !lz_decompress(packed, packed_size, out, size - 1),
+            "%zu bytes of %s decompress into %zu", size, name, size - 1);
+        CHECK(
+            !lz_decompress(packed, packed_size / 2, out, size),
+            "%zu bytes of %s decompress from half their data", size, name);
+    }
+    free(in);
+    free(packed);
+    free(out);
+}
+
+
+int main(void)
+{
+    /* Around the limits of the format: lengths that fill the token's nibble
+     * (15) and go on into extra bytes (15 + 255), and matches further back
+     * than an offset can reach (65535). */
+    static size_t const sizes[] = {
+        0, 1, 2, 3, 4, 5, 14, 15, 16, 269, 270, 271, 65535, 65536, 65537,
+        200000,
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i)
+    {
+        for (enum Fill kind = Fill_Zeros; kind <= Fill_Mixed; ++kind)
+            check_round_trip(sizes[i], kind);
+    }
+    return TEST_RESULT();
+}
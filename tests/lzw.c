@@ -0,0 +1,239 @@
+/*
+ * lzw.c -- Tests for splitting LZW decoding between threads.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "test.h"
+
+#include "gif/gif.h"
+#include "gif/lzw.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/** Pixels in each test image. */
+#define PIXELS      (256 * 1024)
+
+
+/** An LSB-first bit writer, as LZW_Bitstream reads. */
+struct BitWriter
+{
+    uint8_t *out;
+    size_t size;
+    uint64_t bits;
+    unsigned int count;
+};
+
+/** Write the SIZE bit CODE to W. */
+void put_code(struct BitWriter *w, unsigned int code, size_t size)
+{
+    w->bits |= (uint64_t)code << w->count;
+    w->count += size;
+    for (; w->count >= 8; w->count -= 8, w->bits >>= 8)
+        w->out[w->size++] = w->bits & 0xFF;
+}
+
+/**
+ * LZW-compress the SIZE indices IN, each under 2^MIN_CODE_SIZE, into OUT,
+ * returning the compressed size.  A clear code is sent every CLEAR_EVERY
+ * codes, as well as whenever the code table fills up.  OUT needs room for 2
+ * bytes per index, plus a few.
+ */
+size_t compress(
+    uint8_t const *in, size_t size, size_t min_code_size, size_t clear_every,
+    uint8_t *out)
+{
+    /* CHILD[code][byte] is the code for code's string plus byte, or 0. */
+    static uint16_t child[LZW_TABLE_SIZE][256];
+    unsigned int const cc = 1u << min_code_size, eoi = cc + 1;
+    struct BitWriter w = {out, 0, 0, 0};
+    size_t code_size = min_code_size + 1;
+    unsigned int next = eoi + 1;
+    size_t sent = 0;
+
+    memset(child, 0, sizeof(child));
+    put_code(&w, cc, code_size);
+    unsigned int current = size? in[0] : 0;
+    for (size_t i = 1; i < size; ++i)
+    {
+        uint8_t const byte = in[i];
+        if (child[current][byte] != 0)
+        {
+            current = child[current][byte];
+            continue;
+        }
+        put_code(&w, current, code_size);
+        ++sent;
+        if (next == LZW_TABLE_SIZE - 1 || sent % clear_every == 0)
+        {
+            put_code(&w, cc, code_size);
+            memset(child, 0, sizeof(child));
+            code_size = min_code_size + 1;
+            next = eoi + 1;
+        }
+        else
+        {
+            /* The decoder adds this code a code later, so it only grows
+             * its code size once the code after it is in the table. */
+            child[current][byte] = next++;
+            if (next > (1u << code_size) && code_size < 12)
+                code_size++;
+        }
+        current = byte;
+    }
+    if (size != 0)
+        put_code(&w, current, code_size);
+    put_code(&w, eoi, code_size);
+    put_code(&w, 0, 7);
+    return w.size;
+}
+
+/**
+ * Fill the SIZE bytes at OUT with indices under COLORS, in runs like those of
+ * real images, so that codes get long enough to fill the table.
+ */
+void make_indices(uint8_t *out, size_t size, size_t colors, uint32_t seed)
+{
+    uint32_t state = seed;
+    for (size_t i = 0; i < size;)
+    {
+        uint8_t const index = test_random(&state) % colors;
+        size_t run = test_random(&state) % 8 + 1;
+        for (; run > 0 && i < size; --run)
+            out[i++] = index;
+    }
+}
+
+/**
+ * Decode the SIZE bytes of LZW data IN into OUT_SIZE pixels with THREADS
+ * threads, returning the status and leaving the pixels in OUT.
+ */
+enum LZW_Status decode(
+    uint8_t const *in, size_t size, size_t min_code_size,
+    unsigned int threads, uint8_t *out, size_t out_size, size_t *written)
+{
+    static struct LZW_Decoder decoder;
+    lzw_init(&decoder, min_code_size, out, out_size);
+    return lzw_decode_parallel(
+        &decoder, in, size, threads, &gif_default_allocator, written);
+}
+
+/**
+ * Check that decoding IN, SIZE bytes long, in parallel gives the same as
+ * decoding it serially, both whole and into OUT_SIZE pixels.
+ */
+void check_decode(
+    uint8_t const *in, size_t size, size_t min_code_size, size_t out_size,
+    char const *name)
+{
+    uint8_t *const serial = malloc(out_size? out_size : 1);
+    uint8_t *const parallel = malloc(out_size? out_size : 1);
+    if (serial == NULL || parallel == NULL)
+    {
+        fputs("out of memory\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    size_t serial_written, parallel_written;
+    enum LZW_Status const serial_status = unlzw(
+        min_code_size, in, size, serial, out_size, &serial_written);
+    static unsigned int const thread_counts[] = {1, 2, 4, 7};
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(*thread_counts); ++t)
+    {
+        memset(parallel, 0xAA, out_size);
+        enum LZW_Status const status = decode(
+            in, size, min_code_size, thread_counts[t], parallel, out_size,
+            &parallel_written);
+        CHECK(
+            status == serial_status, "%s, %u threads: status %d, not %d",
+            name, thread_counts[t], status, serial_status);
+        CHECK(
+            parallel_written == serial_written,
+            "%s, %u threads: wrote %zu, not %zu", name, thread_counts[t],
+            parallel_written, serial_written);
+        CHECK(
+            memcmp(parallel, serial, out_size) == 0,
+            "%s, %u threads: pixels differ", name, thread_counts[t]);
+    }
+    free(serial);
+    free(parallel);
+}
+
+
+int main(void)
+{
+    static struct
+    {
+        char const *name;
+        size_t min_code_size;
+        size_t colors;
+        size_t clear_every;
+    } const cases[] = {
+        {"clear every 100 codes", 8, 256, 100},
+        {"clear every 1000 codes", 4, 16, 1000},
+        {"clear when full", 8, 256, SIZE_MAX},
+        {"clear when full, 2 colors", 2, 2, SIZE_MAX},
+    };
+
+    uint8_t *const pixels = malloc(PIXELS);
+    uint8_t *const data = malloc(2 * PIXELS + 16);
+    if (pixels == NULL || data == NULL)
+    {
+        fputs("out of memory\n", stderr);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i)
+    {
+        make_indices(pixels, PIXELS, cases[i].colors, i + 1);
+        size_t const size = compress(
+            pixels, PIXELS, cases[i].min_code_size, cases[i].clear_every,
+            data);
+
+        /* The encoder has to be right for the rest to mean anything. */
+        uint8_t *const out = malloc(PIXELS);
+        size_t written;
+        if (out == NULL)
+        {
+            fputs("out of memory\n", stderr);
+            return EXIT_FAILURE;
+        }
+        enum LZW_Status const status = unlzw(
+            cases[i].min_code_size, data, size, out, PIXELS, &written);
+        CHECK(
+            status == LZW_OK && memcmp(out, pixels, PIXELS) == 0,
+            "%s: serial decoding doesn't give back the pixels",
+            cases[i].name);
+        free(out);
+
+        check_decode(
+            data, size, cases[i].min_code_size, PIXELS, cases[i].name);
+        /* Too little room, and too much, for what the data holds. */
+        check_decode(
+            data, size, cases[i].min_code_size, PIXELS / 3, cases[i].name);
+        check_decode(
+            data, size, cases[i].min_code_size, PIXELS + 1000,
+            cases[i].name);
+        /* Data cut off part way through a segment. */
+        check_decode(
+            data, size / 2 + 1, cases[i].min_code_size, PIXELS,
+            cases[i].name);
+    }
+    free(pixels);
+    free(data);
+    return TEST_RESULT();
+}
@@ -0,0 +1,62 @@
+/*
+ * test.h -- Checks shared by the tests.
+ *
+ * Copyright (C) 2022 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_TEST_H
+#define GIFVIEW_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/** Number of checks that have failed so far. */
+static int test_failures = 0;
+
+/**
+ * Check that COND holds, and if not, count a failure and print the printf
+ * style message after it.
+ */
+#define CHECK(cond, ...) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+            fprintf(stderr, __VA_ARGS__); \
+            fputc('\n', stderr); \
+            test_failures++; \
+        } \
+    } while (0)
+
+/** What a test's main should return, given the checks made. */
+#define TEST_RESULT()   (test_failures == 0? EXIT_SUCCESS : EXIT_FAILURE)
+
+
+/** Get the next number from the xorshift generator whose state is *STATE. */
+static inline uint32_t test_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+
+#endif /* GIFVIEW_TEST_H */